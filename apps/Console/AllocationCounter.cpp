@@ -0,0 +1,37 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+// operator new calls of the calling thread
+static thread_local u64 t_numAllocations = 0;
+
+u64 getThreadAllocationCount()
+{
+    return t_numAllocations;
+}
+
+// The other forms of operator new (array, nothrow) call this one, the aligned forms are left to the library
+void* operator new(std::size_t _size)
+{
+    ++t_numAllocations;
+    while (true) {
+        if (void* p = std::malloc(_size ? _size : 1))
+            return p;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* _p) noexcept
+{
+    std::free(_p);
+}
+
+void operator delete(void* _p, std::size_t) noexcept
+{
+    std::free(_p);
+}
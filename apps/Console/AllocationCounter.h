@@ -0,0 +1,7 @@
+#pragma once
+
+#include "Core/type.h"
+
+// The Console replaces the global operator new to count the allocations of each thread, so the perft mode can check
+// that the random playouts never allocate. Allocations of the calling thread so far.
+u64 getThreadAllocationCount();
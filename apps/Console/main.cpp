@@ -4,6 +4,7 @@
 #include <execution>
 
 #include "7WDuel/GameController.h"
+#include "7WDuel/EngineBench.h"
 
 #include "AI/AI.h"
 #include "AI/ML.h"
@@ -12,6 +13,8 @@
 #include "Core/cxxopts.h"
 #include "Core/StringUtil.h"
 
+#include "AllocationCounter.h"
+
 using namespace std::chrono;
 using namespace sevenWD;
 
@@ -114,6 +117,102 @@ static sevenWD::AIInterface* createAIByName(const std::string& name, bool strong
         // Strict semicolon split for main forms
         auto parts = split_char(inner, ';');
 
+        // Named options can follow the positional fields: "reuse" keeps the search trees from one move to the next,
+        // "time=250ms" gives a wall clock budget per move (numMoves is then an upper bound),
+        // "tree=8" searches each determinization with 8 threads sharing its tree (MCTS_Zero only),
+        // "ismcts" searches a single tree over information sets for numMoves * numSimu iterations (MCTS_Zero only),
+        // "tt=16" merges the transpositions of each determinization tree with a 16MB table per thread (MCTS_Zero only),
+        // "cache=64" keeps the network evaluations in a 64MB cache shared by the threads and the moves (MCTS_Zero only)
+        // "gumbel=16" searches the root by sequential halving over 16 moves sampled from the priors (MCTS_Zero only)
+        bool reuseTree = false;
+        u32 timeBudgetMs = 0;
+        u32 numTreeThreads = 1;
+        bool useISMCTS = false;
+        u32 transpositionBudgetMB = 0;
+        u32 nnCacheSizeMB = 0;
+        u32 gumbelNumConsidered = 0;
+        for (auto it = parts.begin(); it != parts.end(); ) {
+            std::string option = trim_copy(*it);
+            if (option == "reuse") {
+                reuseTree = true;
+                it = parts.erase(it);
+            }
+            else if (option.rfind("time=", 0) == 0) {
+                std::string value = option.substr(5);
+                if (value.size() > 2 && value.compare(value.size() - 2, 2, "ms") == 0) {
+                    value.resize(value.size() - 2);
+                }
+                if (!parseUint(value, timeBudgetMs)) {
+                    std::cout << prefix << ": invalid time budget '" << option << "'" << std::endl;
+                    return nullptr;
+                }
+                it = parts.erase(it);
+            }
+            else if (option.rfind("tree=", 0) == 0) {
+                if (!parseUint(option.substr(5), numTreeThreads) || numTreeThreads == 0) {
+                    std::cout << prefix << ": invalid tree thread count '" << option << "'" << std::endl;
+                    return nullptr;
+                }
+                if (!isMCTS_Zero && numTreeThreads > 1) {
+                    std::cout << prefix << ": tree parallel search is only available for MCTS_Zero" << std::endl;
+                    return nullptr;
+                }
+                it = parts.erase(it);
+            }
+            else if (option.rfind("tt=", 0) == 0) {
+                std::string value = option.substr(3);
+                if (value.size() > 2 && value.compare(value.size() - 2, 2, "MB") == 0) {
+                    value.resize(value.size() - 2);
+                }
+                if (!parseUint(value, transpositionBudgetMB)) {
+                    std::cout << prefix << ": invalid transposition table size '" << option << "'" << std::endl;
+                    return nullptr;
+                }
+                if (!isMCTS_Zero && transpositionBudgetMB > 0) {
+                    std::cout << prefix << ": transposition table is only available for MCTS_Zero" << std::endl;
+                    return nullptr;
+                }
+                it = parts.erase(it);
+            }
+            else if (option.rfind("cache=", 0) == 0) {
+                std::string value = option.substr(6);
+                if (value.size() > 2 && value.compare(value.size() - 2, 2, "MB") == 0) {
+                    value.resize(value.size() - 2);
+                }
+                if (!parseUint(value, nnCacheSizeMB)) {
+                    std::cout << prefix << ": invalid network cache size '" << option << "'" << std::endl;
+                    return nullptr;
+                }
+                if (!isMCTS_Zero && nnCacheSizeMB > 0) {
+                    std::cout << prefix << ": network cache is only available for MCTS_Zero" << std::endl;
+                    return nullptr;
+                }
+                it = parts.erase(it);
+            }
+            else if (option.rfind("gumbel=", 0) == 0) {
+                if (!parseUint(option.substr(7), gumbelNumConsidered)) {
+                    std::cout << prefix << ": invalid Gumbel move count '" << option << "'" << std::endl;
+                    return nullptr;
+                }
+                if (!isMCTS_Zero && gumbelNumConsidered > 0) {
+                    std::cout << prefix << ": Gumbel root search is only available for MCTS_Zero" << std::endl;
+                    return nullptr;
+                }
+                it = parts.erase(it);
+            }
+            else if (option == "ismcts") {
+                if (!isMCTS_Zero) {
+                    std::cout << prefix << ": ISMCTS search is only available for MCTS_Zero" << std::endl;
+                    return nullptr;
+                }
+                useISMCTS = true;
+                it = parts.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
         if (parts.size() <= 3) {
             // form: MCTS_Deterministic(numMoves;numSimu)
             if (!parseUint(trim_copy(parts[0]), numMoves)) {
@@ -134,16 +233,27 @@ static sevenWD::AIInterface* createAIByName(const std::string& name, bool strong
             }
 
             if (isMCTS_Zero) {
-                MCTS_Zero* pAI = new MCTS_Zero(numMoves, numSimu);
+                MCTS_Zero* pAI = new MCTS_Zero(numMoves, numSimu, numTreeThreads > 1);
+                pAI->m_reuseTree = reuseTree;
+                pAI->m_timeBudgetMs = timeBudgetMs;
+                pAI->m_numTreeThreads = numTreeThreads;
+                pAI->m_useISMCTS = useISMCTS;
+                pAI->m_transpositionBudgetMB = transpositionBudgetMB;
+                pAI->m_gumbelNumConsidered = gumbelNumConsidered;
+                if (nnCacheSizeMB > 0) {
+                    pAI->enableNNCache(nnCacheSizeMB);
+                }
 				return pAI;
             } else {
                 MCTS_Deterministic* pAI = new MCTS_Deterministic(numMoves, numSimu);
                 pAI->m_heuristic = heuristic;
+                pAI->m_reuseTree = reuseTree;
+                pAI->m_timeBudgetMs = timeBudgetMs;
                 return pAI;
             }
         }
         else if (parts.size() >= 4) {
-            // form: MCTS_Deterministic(numMoves;numSimu;modelName;netName)
+            // form: MCTS_Deterministic(numMoves;numSimu;modelName;netName), MCTS_Zero also takes [;C[;scienceBoost[;nnBatchSize]]]
             if (!parseUint(trim_copy(parts[0]), numMoves)) {
                 std::cout << prefix << ": invalid numMoves '" << parts[0] << "'" << std::endl;
                 return nullptr;
@@ -176,10 +286,24 @@ static sevenWD::AIInterface* createAIByName(const std::string& name, bool strong
                 if (parts.size() >= 5) {
                     parseFloat(trim_copy(parts[4]), pAI->C);
                 }
-                if (parts.size() == 6) {
+                if (parts.size() >= 6) {
                     parseFloat(trim_copy(parts[5]), pAI->m_scienceBoost);
                 }
-
+                if (parts.size() == 7) {
+                    parseUint(trim_copy(parts[6]), pAI->m_nnBatchSize);
+                }
+                pAI->m_reuseTree = reuseTree;
+                pAI->m_timeBudgetMs = timeBudgetMs;
+                pAI->m_numTreeThreads = numTreeThreads;
+                pAI->m_useISMCTS = useISMCTS;
+                pAI->m_transpositionBudgetMB = transpositionBudgetMB;
+                pAI->m_gumbelNumConsidered = gumbelNumConsidered;
+                if (nnCacheSizeMB > 0) {
+                    pAI->enableNNCache(nnCacheSizeMB);
+                }
+                if (numTreeThreads > 1) {
+                    pAI->enableMT();
+                }
                 return pAI;
             }
             else {
@@ -192,6 +316,8 @@ static sevenWD::AIInterface* createAIByName(const std::string& name, bool strong
                 pAI->m_heuristic = MCTS_Deterministic::Heuristic_UseDNN;
                 pAI->m_numMoves = numMoves;
                 pAI->m_numSampling = numSimu;
+                pAI->m_reuseTree = reuseTree;
+                pAI->m_timeBudgetMs = timeBudgetMs;
                 return pAI;
             }
         }
@@ -210,7 +336,7 @@ int main(int argc, char** argv)
     try {
         cxxopts::Options options("Play7WDuel", "Console tool: generate dataset or train network");
         options.add_options()
-            ("mode", "Mode: generate or train or stats", cxxopts::value<std::string>()->default_value("generate"))
+            ("mode", "Mode: generate or train or stats or perft", cxxopts::value<std::string>()->default_value("generate"))
             ("size", "Dataset size (number of games)", cxxopts::value<uint32_t>()->default_value("100"))
             // allow multiple --ai entries, default is two AIs (RandAI and MonteCarloAI)
             ("ai", "AI to include in generation (repeatable).\nList: RandAI MonteCarloAI(numSimu) MCTS_Simple(numSimu;depth;modelName;netName) MCTS_Deterministic(numMove, numSimu)",
@@ -225,6 +351,9 @@ int main(int argc, char** argv)
             ("batch", "Batch size as \"age1;age2;age3\"", cxxopts::value<std::string>()->default_value("32;32;32"))
             ("alpha", "Learning rate for optimizer as \"age1;age2;age3\"", cxxopts::value<std::string>()->default_value("0.001;0.001;0.001"))
             ("threads", "Num threads", cxxopts::value<uint32_t>()->default_value("16"))
+            ("seed", "Random seed (perft)", cxxopts::value<uint32_t>()->default_value("42"))
+            ("depth", "Perft depth from each scripted position", cxxopts::value<uint32_t>()->default_value("4"))
+            ("playouts", "Number of random playouts per thread count (perft)", cxxopts::value<uint32_t>()->default_value("100000"))
             ("help", "Print help");
 
         auto result = options.parse(argc, argv);
@@ -251,6 +380,7 @@ int main(int argc, char** argv)
             Tournament tournament;
 
 			u32 numAIsAdded = 0;
+            std::vector<sevenWD::AIInterface*> AIs;
             for (const auto& name : aiNames) {
                 sevenWD::AIInterface* p = createAIByName(name, strongPlay);
                 if (!p) {
@@ -258,6 +388,7 @@ int main(int argc, char** argv)
                     continue;
                 }
                 tournament.addAI(p);
+                AIs.push_back(p);
                 numAIsAdded++;
             }
 
@@ -276,6 +407,17 @@ int main(int argc, char** argv)
             tournament.generateDataset(context, size, numThreads);
             tournament.print();
 
+            for (sevenWD::AIInterface* pAI : AIs) {
+                MCTS_Zero* pZero = dynamic_cast<MCTS_Zero*>(pAI);
+                if (pZero && pZero->m_nnCache) {
+                    std::cout << pZero->getName() << " network cache: " << pZero->m_nnCache->getNumHits() << " hits, "
+                        << pZero->m_nnCache->getNumMisses() << " misses" << std::endl;
+                }
+            }
+            if (MCTS_Arena::getHighWaterMark() > 0) {
+                std::cout << "Largest MCTS tree: " << MCTS_Arena::getHighWaterMark() / 1024 << " KB" << std::endl;
+            }
+
             tournament.serializeDataset(outPrefix);
             // Write a copy if
             {
@@ -403,6 +545,33 @@ int main(int argc, char** argv)
 
             return 0;
         }
+        else if (mode == "perft") {
+            // Engine throughput and correctness oracle: leaf counts only change if the rules or move generation change
+            GameContext context(result["seed"].as<uint32_t>());
+            uint32_t depth = result["depth"].as<uint32_t>();
+            uint32_t numPlayouts = result["playouts"].as<uint32_t>();
+            uint32_t maxThreads = result["threads"].as<uint32_t>();
+
+            for (EngineBench::Position& position : EngineBench::makeScriptedPositions(context)) {
+                auto t1 = steady_clock::now();
+                u64 numLeaves = EngineBench::perft(position.m_game, depth);
+                duration<double> elapsed = steady_clock::now() - t1;
+                std::cout << "perft " << position.m_name << " depth " << depth << ": " << numLeaves << " leaves, "
+                    << u64(numLeaves / elapsed.count()) << " leaves/s" << std::endl;
+            }
+
+            for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+                EngineBench::PlayoutStats stats = EngineBench::runPlayouts(context, numPlayouts, numThreads, &getThreadAllocationCount);
+                std::cout << "playouts threads " << numThreads << ": " << u64(stats.m_numPlayouts / stats.m_seconds) << " playouts/s, "
+                    << u64(stats.m_numPlays / stats.m_seconds) << " play/s, "
+                    << u64(stats.m_numEnumerates / stats.m_seconds) << " enumerateMoves/s, checksum " << std::hex << stats.m_checksum << std::dec << std::endl;
+                if (stats.m_numAllocations > 0) {
+                    std::cout << "Error: " << stats.m_numAllocations << " allocations during the playouts, a random game should never allocate." << std::endl;
+                    return 1;
+                }
+            }
+            return 0;
+        }
         else {
             std::cout << "Unknown mode: " << mode << ". Use 'generate' or 'train'." << std::endl;
             return 1;
@@ -65,9 +65,12 @@ int main(int argc, char** argv)
         // return 1;
     }
 
+    // keep the search trees from one move to the next, the AI ponders on them while the human thinks
+    activeAI->m_reuseTree = true;
+
     std::cout << "Loaded AI: " << activeAI->getName() << "\n";
 
-    // create per-thread context for the active AI (may be nullptr for simple AIs)
+    // create per-thread context for the active AI, it holds the trees reused by all its searches
     void* aiThreadCtx = activeAI->createPerThreadContext();
 
     // -----------------------------------------------------------
@@ -224,6 +227,15 @@ int main(int argc, char** argv)
         }
     };
 
+    // Pondering: the AI searches the current position until the next space press, its next search then continues
+    // from the subtree of the moves played in the meantime
+    auto restartPondering = [&]()
+    {
+        activeAI->stopPondering(aiThreadCtx);
+        if (!isGameOver())
+            activeAI->startPondering(gameContext, gameController, aiThreadCtx);
+    };
+
     auto playMove = [&](const sevenWD::Move& move)
     {
         const u32 actingPlayer = gameController.m_gameState.getCurrentPlayerTurn();
@@ -236,6 +248,8 @@ int main(int argc, char** argv)
         history.push_back(Snapshot{ gameController.m_gameState, gameController.m_winType, uiGameState });
         historyIndex = history.size() - 1;
 
+        restartPondering();
+
         // Invalidate AI score display when human plays (optional)
         // lastAIScoreValid = false;
 
@@ -316,6 +330,9 @@ int main(int argc, char** argv)
                                 gameController.enumerateMoves(moves);
                                 if (!moves.empty())
                                 {
+                                    // the search picks up the pondered tree, settings only change between searches
+                                    activeAI->stopPondering(aiThreadCtx);
+
                                     // Update AI parameters from sliders
 									activeAI->m_numSampling = sliderAINumSamples.value;
 									activeAI->m_numMoves = sliderNumSimu.value;
@@ -323,8 +340,6 @@ int main(int argc, char** argv)
                                     // Launch AI computation in background to avoid blocking UI.
                                     // Make a copy of the current GameController for the AI to work on.
                                     sevenWD::GameController controllerCopy = gameController;
-                                    // create a per-thread context for this background task
-                                    void* bgCtx = activeAI->createPerThreadContext();
 
                                     aiThinking.store(true);
                                     lastAIScoreValid = false;
@@ -332,13 +347,10 @@ int main(int argc, char** argv)
 
                                     // Launch async task
                                     aiTask = std::async(std::launch::async,
-                                        [activeAI, &gameContext, controllerCopy = std::move(controllerCopy), moves = std::move(moves), bgCtx]() mutable -> std::pair<sevenWD::Move, float>
+                                        [activeAI, &gameContext, controllerCopy = std::move(controllerCopy), moves = std::move(moves), aiThreadCtx]() mutable -> std::pair<sevenWD::Move, float>
                                         {
                                             // compute choice (may be expensive)
-                                            auto result = activeAI->selectMove(gameContext, controllerCopy, moves, bgCtx);
-                                            // cleanup per-thread context used by this background job
-                                            activeAI->destroyPerThreadContext(bgCtx);
-                                            return result;
+                                            return activeAI->selectMove(gameContext, controllerCopy, moves, aiThreadCtx);
                                         });
                                 }
                                 else
@@ -356,6 +368,8 @@ int main(int argc, char** argv)
                     {
                         historyIndex--;
                         restoreSnapshot(historyIndex);
+                        if (!aiThinking.load())
+                            restartPondering();
                     }
                 }
                 else if (e.key.key == SDLK_RIGHT)
@@ -365,6 +379,8 @@ int main(int argc, char** argv)
                     {
                         historyIndex++;
                         restoreSnapshot(historyIndex);
+                        if (!aiThinking.load())
+                            restartPondering();
                     }
                 }
                 else if (e.key.key == SDLK_H)
@@ -779,7 +795,9 @@ int main(int argc, char** argv)
         SDL_RenderPresent(renderer.GetSDLRenderer());
     }
 
-    // If background AI still created a per-thread context (main thread), clean it up
+    // the context is shared with the background search and the pondering, destroying it stops the pondering
+    if (aiTask.valid())
+        aiTask.wait();
     activeAI->destroyPerThreadContext(aiThreadCtx);
 
     SDL_DestroyWindow(gWindow);
@@ -0,0 +1,147 @@
+#include "7WDuel/EngineBench.h"
+
+#include <chrono>
+#include <thread>
+
+namespace sevenWD::EngineBench
+{
+	namespace
+	{
+		// Random streams used to reach the scripted positions, away from the ones used by runPlayouts()
+		constexpr u64 ScriptedPositionStream = 1ull << 62;
+
+		struct Script
+		{
+			const char* m_name;
+			bool (*m_isReached)(const GameState& _state);
+		};
+
+		const Script s_scripts[] =
+		{
+			{ "Draft", [](const GameState& _state) { return _state.isDraftingWonders(); } },
+			{ "Age1", [](const GameState& _state) { return !_state.isDraftingWonders() && _state.getCurrentAge() == 0; } },
+			{ "Age2", [](const GameState& _state) { return _state.getCurrentAge() == 1; } },
+			{ "Age3", [](const GameState& _state) { return _state.getCurrentAge() == 2; } },
+			{ "LateAge3", [](const GameState& _state) { return _state.getCurrentAge() == 2 && _state.m_numPlayedAgeCards >= 14; } },
+		};
+	}
+
+	//----------------------------------------------------------------------------
+	std::vector<Position> makeScriptedPositions(const GameContext& _context)
+	{
+		std::vector<Position> positions;
+		u64 stream = ScriptedPositionStream;
+
+		for (const Script& script : s_scripts)
+		{
+			// a game can end before reaching the position (military or science victory), try the next stream
+			while (true)
+			{
+				_context.seedRand(stream++);
+				GameController game(_context);
+				std::unique_ptr<GameState::DeterminizedSetup> pSetup = std::make_unique<GameState::DeterminizedSetup>();
+				game.m_gameState.makeDeterministic(*pSetup);
+
+				GameController::MoveList moves;
+				bool end = false;
+				while (!end)
+				{
+					GameState::State state = game.m_gameState.m_state;
+					if ((state == GameState::State::DraftWonder || state == GameState::State::Play) && script.m_isReached(game.m_gameState))
+						break;
+
+					game.enumerateMoves(moves);
+					end = game.play(moves[_context.rand()() % moves.size()]);
+				}
+
+				if (!end)
+				{
+					positions.push_back({ script.m_name, game, std::move(pSetup) });
+					break;
+				}
+			}
+		}
+
+		return positions;
+	}
+
+	//----------------------------------------------------------------------------
+	u64 perft(GameController& _game, u32 _depth)
+	{
+		if (_depth == 0)
+			return 1;
+
+		GameController::MoveList moves;
+		_game.enumerateMoves(moves);
+
+		u64 numLeaves = 0;
+		GameController::UndoRecord record;
+		for (const Move& move : moves)
+		{
+			if (_game.play(move, record))
+				numLeaves++;
+			else
+				numLeaves += perft(_game, _depth - 1);
+			_game.undo(record);
+		}
+		return numLeaves;
+	}
+
+	//----------------------------------------------------------------------------
+	PlayoutStats runPlayouts(const GameContext& _context, u32 _numPlayouts, u32 _numThreads, AllocationCounter _countAllocations)
+	{
+		std::vector<PlayoutStats> perThreadStats(_numThreads);
+
+		auto processRange = [&](u32 _threadIndex)
+		{
+			PlayoutStats stats; // local copy, counters of different threads would share cache lines
+			GameController::MoveList moves;
+
+			for (u32 i = _threadIndex; i < _numPlayouts; i += _numThreads)
+			{
+				const u64 numAllocations = _countAllocations ? _countAllocations() : 0;
+				_context.seedRand(i + 1);
+				GameController game(_context);
+
+				bool end = false;
+				while (!end)
+				{
+					game.enumerateMoves(moves);
+					end = game.play(moves[_context.rand()() % moves.size()]);
+					stats.m_numEnumerates++;
+					stats.m_numPlays++;
+				}
+
+				stats.m_numPlayouts++;
+				stats.m_checksum ^= game.m_gameState.getHash();
+				if (_countAllocations)
+					stats.m_numAllocations += _countAllocations() - numAllocations;
+			}
+			perThreadStats[_threadIndex] = stats;
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::vector<std::thread> threads;
+			for (u32 t = 1; t < _numThreads; ++t)
+				threads.emplace_back(processRange, t);
+			processRange(0);
+
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		PlayoutStats total;
+		for (const PlayoutStats& stats : perThreadStats)
+		{
+			total.m_numPlayouts += stats.m_numPlayouts;
+			total.m_numPlays += stats.m_numPlays;
+			total.m_numEnumerates += stats.m_numEnumerates;
+			total.m_checksum ^= stats.m_checksum;
+			total.m_numAllocations += stats.m_numAllocations;
+		}
+		total.m_seconds = elapsed.count();
+		return total;
+	}
+}
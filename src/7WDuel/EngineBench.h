@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GameController.h"
+
+#include <memory>
+
+namespace sevenWD::EngineBench
+{
+	// Deterministic positions reached by seeded random games, the same context seed always gives the same positions
+	struct Position
+	{
+		const char* m_name;
+		GameController m_game;
+		std::unique_ptr<GameState::DeterminizedSetup> m_determinizedSetup; // future ages of m_game
+	};
+	std::vector<Position> makeScriptedPositions(const GameContext& _context);
+
+	// Number of leaves of the move tree at _depth, a finished game counts as a leaf.
+	// _game is explored in place with play/undo and is unchanged on return.
+	u64 perft(GameController& _game, u32 _depth);
+
+	struct PlayoutStats
+	{
+		u64 m_numPlayouts = 0;
+		u64 m_numPlays = 0;
+		u64 m_numEnumerates = 0;
+		u64 m_checksum = 0; // xor of the final state hashes, does not depend on the thread count
+		u64 m_numAllocations = 0; // operator new calls during the games, a random game should never allocate (0 without counter)
+		double m_seconds = 0.0;
+	};
+	// Allocations made by the calling thread so far. The engine does not count them: a program replacing operator new
+	// passes its counter to runPlayouts() to check the games.
+	using AllocationCounter = u64 (*)();
+
+	// Random games spread over _numThreads threads, game i uses the random stream i + 1 of the context
+	PlayoutStats runPlayouts(const GameContext& _context, u32 _numPlayouts, u32 _numThreads, AllocationCounter _countAllocations = nullptr);
+}
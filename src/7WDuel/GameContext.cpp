@@ -1,10 +1,25 @@
 #include "7WDuel/GameContext.h"
 #include "7WDuel/GameEngine.h"
 
+#include <atomic>
+
 namespace sevenWD
 {
+	namespace
+	{
+		struct ThreadRandomStream
+		{
+			core::RandomStream m_stream;
+			bool m_isSeeded = false;
+		};
+		thread_local ThreadRandomStream t_randomStream;
+
+		// Streams given to threads which never called seedRand(), out of the range used by games
+		std::atomic<u64> s_nextThreadStream = 1ull << 63;
+	}
+
 	//----------------------------------------------------------------------------
-	GameContext::GameContext(unsigned _seed) : m_rand(_seed)
+	GameContext::GameContext(unsigned _seed) : m_seed(_seed)
 	{
 		m_allCards.clear();
 		fillAge1();
@@ -15,6 +30,35 @@ namespace sevenWD
 		fillScienceTokens();
 	}
 
+	//----------------------------------------------------------------------------
+	core::RandomStream& GameContext::rand() const
+	{
+		if (!t_randomStream.m_isSeeded)
+			seedRand(s_nextThreadStream.fetch_add(1));
+
+		return t_randomStream.m_stream;
+	}
+
+	void GameContext::seedRand(u64 _stream) const
+	{
+		t_randomStream.m_stream.seed(m_seed, _stream);
+		t_randomStream.m_isSeeded = true;
+	}
+
+	//----------------------------------------------------------------------------
+	ScopedRandStream::ScopedRandStream(const GameContext& _context, u64 _stream)
+		: m_previousStream(t_randomStream.m_stream)
+		, m_wasSeeded(t_randomStream.m_isSeeded)
+	{
+		_context.seedRand(_stream);
+	}
+
+	ScopedRandStream::~ScopedRandStream()
+	{
+		t_randomStream.m_stream = m_previousStream;
+		t_randomStream.m_isSeeded = m_wasSeeded;
+	}
+
 	//----------------------------------------------------------------------------
 	void GameContext::initCityWithRandomWonders(PlayerCity& _player1, PlayerCity& _player2) const
 	{
@@ -25,7 +69,7 @@ namespace sevenWD
 		for (u32 i = 0; i < wonders.size(); ++i)
 			wonders[i] = Wonders(i);
 
-		std::shuffle(wonders.begin(), wonders.end(), m_rand);
+		std::shuffle(wonders.begin(), wonders.end(), rand());
 
 		_player1.m_unbuildWonderCount = 4;
 		for (u32 i = 0; i < 4; ++i)
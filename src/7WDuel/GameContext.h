@@ -1,5 +1,6 @@
 #pragma once
 #include "Core/Common.h"
+#include "Core/Random.h"
 #include "Card.h"
 
 #include <random>
@@ -17,7 +18,12 @@ namespace sevenWD
 		void initCityWithRandomWonders(PlayerCity& _player1, PlayerCity& _player2) const;
 		void initCityWithFixedWonders(PlayerCity& _player1, PlayerCity& _player2) const;
 
-		std::default_random_engine& rand() const { return m_rand; }
+		// Random stream of the calling thread, threads never share a generator and the contexts of a thread share its
+		// stream. A thread which never called seedRand() starts on its own stream.
+		core::RandomStream& rand() const;
+		// Restart the calling thread stream on stream _stream of the seed, e.g. one stream per game to make a game
+		// reproducible whatever the thread it is played on.
+		void seedRand(u64 _stream) const;
 		const Card& getCard(u8 _cardId) const { return *m_allCards[_cardId]; }
 		const Card& getWonder(Wonders _wonder) const { return m_wonders[u32(_wonder)]; }
 		const Card& getScienceToken(ScienceToken _token) const { return m_scienceTokens[u32(_token)]; }
@@ -37,7 +43,7 @@ namespace sevenWD
 		static constexpr u32 MaxCardsPerAge = 30;
 
 	private:
-		mutable std::default_random_engine m_rand;
+		u64 m_seed;
 		std::vector<Card> m_age1Cards;
 		std::vector<Card> m_age2Cards;
 		std::vector<Card> m_age3Cards;
@@ -54,4 +60,23 @@ namespace sevenWD
 		void fillWonders();
 		void fillScienceTokens();
 	};
+
+	//----------------------------------------------------------------------------
+	// Puts the calling thread on stream _stream of the context seed for its lifetime, then gives the previous stream
+	// back. The samplings of a search each get one, so they draw the same numbers whatever the thread running them and
+	// leave the stream of that thread untouched.
+	class ScopedRandStream
+	{
+	public:
+		ScopedRandStream(const GameContext& _context, u64 _stream);
+		~ScopedRandStream();
+
+	private:
+		core::RandomStream m_previousStream;
+		bool m_wasSeeded;
+
+		// non-copyable
+		ScopedRandStream(const ScopedRandStream&) = delete;
+		ScopedRandStream& operator=(const ScopedRandStream&) = delete;
+	};
 }
\ No newline at end of file
@@ -19,10 +19,11 @@ namespace sevenWD
 		}
 		else if (m_gameState.m_state == State::Play)
 		{
+			const PlayerCity::ResourcePrices prices = m_gameState.getCurrentPlayerCity().computeResourcePrices(m_gameState.getOtherPlayerCity());
 			for (u8 i = 0; i < m_gameState.getNumPlayableCards(); ++i)
 			{
 				const Card& card = m_gameState.getPlayableCard(i);
-				u32 cost = m_gameState.getCurrentPlayerCity().computeCost(card, m_gameState.getOtherPlayerCity());
+				u32 cost = m_gameState.getCurrentPlayerCity().computeCost(card, prices);
 				if (cost <= m_gameState.getCurrentPlayerCity().m_gold)
 				{
 					Move move = Move{ i, Move::Action::Pick };
@@ -44,7 +45,7 @@ namespace sevenWD
 					Wonders wonder = m_gameState.getCurrentPlayerCity().m_unbuildWonders[i];
 					const Card& wonderCard = m_gameState.m_context->getWonder(wonder);
 
-					u32 cost = m_gameState.getCurrentPlayerCity().computeCost(wonderCard, m_gameState.getOtherPlayerCity());
+					u32 cost = m_gameState.getCurrentPlayerCity().computeCost(wonderCard, prices);
 					if (cost <= m_gameState.getCurrentPlayerCity().m_gold)
 					{
 						for (u8 burnIndex = 0; burnIndex < m_gameState.getNumPlayableCards(); ++burnIndex)
@@ -89,7 +90,7 @@ namespace sevenWD
 
 							case Wonders::Mausoleum:
 							{
-								std::vector<u8> revivableCards;
+								DiscardedCards::RevivableCardList revivableCards;
 								m_gameState.m_discardedCards.getRevivableCards(revivableCards);
 								
 								if (revivableCards.empty())
@@ -151,6 +152,14 @@ namespace sevenWD
 		});
 	}
 
+	void GameController::enumerateMoves(MoveList& _moves) const
+	{
+		_moves.clear();
+		enumerateMoves([&](const Move& move) {
+			_moves.push_back(move);
+		});
+	}
+
 	u32 GameController::enumerateMoves(Move outMoves[], u32 bufferSize) const
 	{
 		u32 count = 0;
@@ -163,6 +172,33 @@ namespace sevenWD
 	}
 
 	bool GameController::play(Move _move)
+	{
+		bool isGameOver = playInternal(_move);
+#ifdef _DEBUG
+		DEBUG_ASSERT(m_gameState.getHash() == m_gameState.computeHash());
+#endif
+		return isGameOver;
+	}
+
+	bool GameController::play(Move _move, UndoRecord& _record)
+	{
+		bool playGraphCard = _move.action == Move::Pick || _move.action == Move::Burn || _move.action == Move::BuildWonder || _move.action == Move::BuildMausoleum;
+		m_gameState.saveUndoRecord(_record.m_gameState, playGraphCard ? _move.playableCard : u8(-1));
+		_record.m_winType = m_winType;
+		return play(_move);
+	}
+
+	void GameController::undo(const UndoRecord& _record)
+	{
+		m_gameState.undo(_record.m_gameState);
+		m_winType = _record.m_winType;
+
+#if defined(RECORD_GAME_HISTORY)
+		m_gameHistory.pop_back();
+#endif
+	}
+
+	bool GameController::playInternal(Move _move)
 	{
 #if defined(RECORD_GAME_HISTORY)
 		std::stringstream strstream;
@@ -176,7 +212,7 @@ namespace sevenWD
 		if (_move.action == Move::DraftWonder)
 		{
 			m_gameState.draftWonder(_move.playableCard);
-			m_gameState.m_state = m_gameState.isDraftingWonders() ? State::DraftWonder : State::Play;
+			m_gameState.setState(m_gameState.isDraftingWonders() ? State::DraftWonder : State::Play);
 			return false;
 		}
 		else if (_move.action == Move::Pick)
@@ -184,7 +220,7 @@ namespace sevenWD
 			action = m_gameState.pick(_move.playableCard);
 			if (action == sevenWD::SpecialAction::TakeScienceToken && m_gameState.m_numScienceToken)
 			{
-				m_gameState.m_state = State::PickScienceToken;
+				m_gameState.setState(State::PickScienceToken);
 				return false;
 			}
 		}
@@ -196,7 +232,7 @@ namespace sevenWD
 			action = m_gameState.buildWonder(_move.playableCard, _move.wonderIndex, _move.additionalId);
 			if (wonder == Wonders::GreatLibrary)
 			{
-				m_gameState.m_state = action == SpecialAction::Replay ? State::GreatLibraryTokenThenReplay : State::GreatLibraryToken;
+				m_gameState.setState(action == SpecialAction::Replay ? State::GreatLibraryTokenThenReplay : State::GreatLibraryToken);
 				return false;
 			}
 		}
@@ -217,7 +253,7 @@ namespace sevenWD
 		if (action == sevenWD::SpecialAction::MilitaryWin || action == sevenWD::SpecialAction::ScienceWin)
 		{
 			m_winType = action == sevenWD::SpecialAction::MilitaryWin ? WinType::Military : WinType::Science;
-			m_gameState.m_state = m_gameState.getCurrentPlayerTurn() == 0 ? State::WinPlayer0 : State::WinPlayer1;
+			m_gameState.setState(m_gameState.getCurrentPlayerTurn() == 0 ? State::WinPlayer0 : State::WinPlayer1);
 			return true;
 		}
 
@@ -230,11 +266,11 @@ namespace sevenWD
 		else if (ageState == sevenWD::GameState::NextAge::EndGame)
 		{
 			m_winType = WinType::Civil;
-			m_gameState.m_state = m_gameState.findWinner() == 0 ? State::WinPlayer0 : State::WinPlayer1;
+			m_gameState.setState(m_gameState.findWinner() == 0 ? State::WinPlayer0 : State::WinPlayer1);
 			return true;
 		}
 
-		m_gameState.m_state = State::Play;
+		m_gameState.setState(State::Play);
  
 		return false;
 	}
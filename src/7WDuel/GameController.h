@@ -12,6 +12,11 @@ namespace sevenWD
 		u8 wonderIndex = u8(-1);
 		u8 additionalId = u8(-1);
 
+		bool operator==(const Move& _other) const
+		{
+			return playableCard == _other.playableCard && action == _other.action && wonderIndex == _other.wonderIndex && additionalId == _other.additionalId;
+		}
+
 		u32 computeMoveFixedIndex(const GameContext& ctx) const
 		{
 			DEBUG_ASSERT(playableCard < 6 || playableCard == u8(-1));
@@ -56,16 +61,21 @@ namespace sevenWD
 	{
 		static constexpr u32 cMaxNumMoves = 42; // 6 pickable cards * (pick + burn + (buildWonders * 4) + SpecialMausoleum) = 6*(1+1+4+1)=42
 
+		// Upper bound of enumerateMoves() output: 6 pickable cards * (pick + burn + one move per Zeus (3), CircusMaximus (2),
+		// Mausoleum (revived card) and other wonder target)
+		static constexpr u32 cMaxMoveListSize = 6 * (2 + 3 + 2 + DiscardedCards::cMaxRevivableCards + 1);
+		using MoveList = core::FixedVector<Move, cMaxMoveListSize>;
+
 		using State = GameState::State;
 
 		GameController(const GameContext& _context, bool autoDraftWonders = false) : m_gameState(_context)
 		{
-			m_gameState.m_state = m_gameState.isDraftingWonders() ? State::DraftWonder : State::Play;
+			m_gameState.setState(m_gameState.isDraftingWonders() ? State::DraftWonder : State::Play);
 			if (autoDraftWonders) {
 				while (m_gameState.isDraftingWonders()) {
 					m_gameState.draftWonder(0);
 				}
-				m_gameState.m_state = State::Play;
+				m_gameState.setState(State::Play);
 			}
 		}
 
@@ -73,9 +83,19 @@ namespace sevenWD
 		void enumerateMoves(Fun&& _fun) const;
 
 		void enumerateMoves(std::vector<Move>&) const;
+		void enumerateMoves(MoveList&) const;
 		u32 enumerateMoves(Move outMoves[], u32 bufferSize) const;
 		bool play(Move _move);
 
+		// Play a move in place, _record allows to restore the exact previous state with undo()
+		struct UndoRecord
+		{
+			GameState::UndoRecord m_gameState;
+			WinType m_winType;
+		};
+		bool play(Move _move, UndoRecord& _record);
+		void undo(const UndoRecord& _record);
+
 		bool filterMove(Move _move) const;
 	
 		GameState m_gameState;
@@ -87,5 +107,8 @@ namespace sevenWD
 #endif
 
 		std::ostream& printMove(std::ostream& out, Move move) const;
+
+	private:
+		bool playInternal(Move _move); // play() without the debug check of the incremental hash
 	};
 }
\ No newline at end of file
@@ -85,9 +85,10 @@ namespace sevenWD
 	{
 		initScienceTokens();
 		initWonderDraft();
+		initHash();
 	}
 
-	void GameState::makeDeterministic()
+	void GameState::makeDeterministic(DeterminizedSetup& _setup)
 	{
 		if (m_currentDraftRound < 2) {
 			const u32 firstOutOfDraftWonderIndex = (m_currentDraftRound + 1) * 4;
@@ -97,19 +98,121 @@ namespace sevenWD
 		// fix a random order for draftable science tokens (Great Library)
 		std::shuffle(m_scienceTokens.begin() + 5, m_scienceTokens.end(), m_context->rand());
 
+		// Future ages are fixed from now on, they are shared by all the states reached from this one
+		_setup = DeterminizedSetup{};
 		if (isDraftingWonders())
-			initAge1Graph(true);
+			initAge1Graph(_setup.m_graphsPerAge[0], true);
 		if (isDraftingWonders() || m_currentAge < 1)
-			initAge2Graph(true);
+			initAge2Graph(_setup.m_graphsPerAge[1], true);
 		if (isDraftingWonders() || m_currentAge < 2)
-			initAge3Graph(true);
+			initAge3Graph(_setup.m_graphsPerAge[2], true);
+		m_pDeterminizedSetup = &_setup;
 
 		if (!isDraftingWonders()) {
 			// Determine cur non visible cards
 			for (CardNode& node : m_graph.m_graph)
 				pickCardAdnInitNode(node, m_graph);
 		}
-		m_isDeterministic = true;
+
+		// Hidden cards are not part of the key but the great library draft may have been reshuffled
+		initHash();
+	}
+
+	//----------------------------------------------------------------------------
+	void GameState::saveUndoRecord(UndoRecord& _record, u8 _playableCardIndex) const
+	{
+		_record.m_playerCity = m_playerCity;
+		_record.m_discardedCards = m_discardedCards;
+		_record.m_scienceTokens = m_scienceTokens;
+		_record.m_wonderDraftPool = m_wonderDraftPool;
+		_record.m_hash = m_hash;
+		_record.m_cityHash = m_cityHash;
+
+		_record.m_state = m_state;
+		_record.m_numScienceToken = m_numScienceToken;
+		_record.m_numPlayedAgeCards = m_numPlayedAgeCards;
+		_record.m_playedAgeCard = m_numPlayedAgeCards < m_playedAgeCards.size() ? m_playedAgeCards[m_numPlayedAgeCards] : 0;
+		_record.m_numTurnPlayed = m_numTurnPlayed;
+		_record.m_playerTurn = m_playerTurn;
+		_record.m_currentAge = m_currentAge;
+		_record.m_military = m_military;
+		for (u32 i = 0; i < 2; ++i) {
+			_record.militaryToken2[i] = militaryToken2[i];
+			_record.militaryToken5[i] = militaryToken5[i];
+		}
+		_record.m_currentDraftRound = m_currentDraftRound;
+		_record.m_picksInCurrentRound = m_picksInCurrentRound;
+
+		// Last card of an age (possibly followed by a science token pick) or end of the draft, the graph is replaced
+		_record.m_hasFullGraph = isDraftingWonders() || m_graph.m_numPlayableCards <= 1;
+		if (_record.m_hasFullGraph)
+		{
+			_record.m_graph = m_graph;
+			return;
+		}
+
+		_record.m_parentIndex = { u8(CardNode::InvalidNode), u8(CardNode::InvalidNode) };
+		if (_playableCardIndex < m_graph.m_numPlayableCards)
+		{
+			const CardNode& node = m_graph.m_graph[m_graph.m_playableCards[_playableCardIndex]];
+			_record.m_parentIndex = { u8(node.m_parent0), u8(node.m_parent1) };
+			for (u32 i = 0; i < 2; ++i) {
+				if (_record.m_parentIndex[i] != CardNode::InvalidNode)
+					_record.m_parentNode[i] = m_graph.m_graph[_record.m_parentIndex[i]];
+			}
+		}
+		_record.m_playableCards = m_graph.m_playableCards;
+		_record.m_availableAgeCards = m_graph.m_availableAgeCards;
+		_record.m_availableGuildCards = m_graph.m_availableGuildCards;
+		_record.m_numPlayableCards = m_graph.m_numPlayableCards;
+		_record.m_numAvailableAgeCards = m_graph.m_numAvailableAgeCards;
+		_record.m_numAvailableGuildCards = m_graph.m_numAvailableGuildCards;
+	}
+
+	void GameState::undo(const UndoRecord& _record)
+	{
+		m_playerCity = _record.m_playerCity;
+		m_discardedCards = _record.m_discardedCards;
+		m_scienceTokens = _record.m_scienceTokens;
+		m_wonderDraftPool = _record.m_wonderDraftPool;
+		m_hash = _record.m_hash;
+		m_cityHash = _record.m_cityHash;
+
+		m_state = _record.m_state;
+		m_numScienceToken = _record.m_numScienceToken;
+		m_numPlayedAgeCards = _record.m_numPlayedAgeCards;
+		if (m_numPlayedAgeCards < m_playedAgeCards.size())
+			m_playedAgeCards[m_numPlayedAgeCards] = _record.m_playedAgeCard;
+		m_numTurnPlayed = _record.m_numTurnPlayed;
+		m_playerTurn = _record.m_playerTurn;
+		m_currentAge = _record.m_currentAge;
+		m_military = _record.m_military;
+		for (u32 i = 0; i < 2; ++i) {
+			militaryToken2[i] = _record.militaryToken2[i];
+			militaryToken5[i] = _record.militaryToken5[i];
+		}
+		m_currentDraftRound = _record.m_currentDraftRound;
+		m_picksInCurrentRound = _record.m_picksInCurrentRound;
+
+		if (_record.m_hasFullGraph)
+		{
+			m_graph = _record.m_graph;
+		}
+		else
+		{
+			for (u32 i = 0; i < 2; ++i) {
+				if (_record.m_parentIndex[i] != CardNode::InvalidNode)
+					m_graph.m_graph[_record.m_parentIndex[i]] = _record.m_parentNode[i];
+			}
+			m_graph.m_playableCards = _record.m_playableCards;
+			m_graph.m_availableAgeCards = _record.m_availableAgeCards;
+			m_graph.m_availableGuildCards = _record.m_availableGuildCards;
+			m_graph.m_numPlayableCards = _record.m_numPlayableCards;
+			m_graph.m_numAvailableAgeCards = _record.m_numAvailableAgeCards;
+			m_graph.m_numAvailableGuildCards = _record.m_numAvailableGuildCards;
+		}
+
+		updatePlaybleCardPtrDebug();
 	}
 
 #ifdef _DEBUG
@@ -152,13 +255,16 @@ namespace sevenWD
 	{
 		// Also initialize beginning of the game
 		m_currentDraftRound = 2;
-		m_playerTurn = 0;
+		setPlayerTurn(0);
 
+		m_hash ^= computeGraphHash() ^ computePlayableCardsHash();
 		initAge1();
+		m_hash ^= computeGraphHash() ^ computePlayableCardsHash();
 	}
 
 	void GameState::draftWonder(u32 _draftIndex)
 	{
+		m_hash ^= computeDraftHash();
 		{
 			PlayerCity& city = getCurrentPlayerCity();
 			DEBUG_ASSERT(isDraftingWonders() && city.m_unbuildWonderCount < 4);
@@ -178,7 +284,7 @@ namespace sevenWD
 
 		if (m_picksInCurrentRound == 1) {
 			// after starter picked, other player picks next
-			m_playerTurn = (roundStarter + 1) % 2;
+			setPlayerTurn((roundStarter + 1) % 2);
 		} else if (m_picksInCurrentRound == 2) {
 			// other player's first pick: they pick again (keep same playerTurn)
 		} else if (m_picksInCurrentRound == 3) {
@@ -195,14 +301,18 @@ namespace sevenWD
 			m_picksInCurrentRound = 0;
 
 			if (m_currentDraftRound < 2) {
-				if (!m_isDeterministic) {
+				if (!isDeterministic()) {
 					std::shuffle(m_wonderDraftPool.begin() + 4, m_wonderDraftPool.end(), m_context->rand());
 				}
-				m_playerTurn = 1;
+				setPlayerTurn(1);
 			} else {
 				finishWonderDraft();
 			}
 		}
+
+		m_hash ^= computeDraftHash();
+		updateCityHash(0);
+		updateCityHash(1);
 	}
 
 	u8 GameState::getNumDraftableWonders() const
@@ -250,6 +360,8 @@ namespace sevenWD
 	{
 		if (military > 0)
 		{
+			m_hash ^= computeMilitaryHash();
+
 			u8 militaryBonus = hasStrategyToken ? 1 : 0;
 			m_military += (m_playerTurn == 0 ? (military + militaryBonus) : -(military + militaryBonus));
 
@@ -273,22 +385,49 @@ namespace sevenWD
 				militaryToken5[1] = true;
 				m_playerCity[0].m_gold = Helper::safeSub<u8>(m_playerCity[0].m_gold, 5);
 			}
+
+			m_hash ^= computeMilitaryHash();
 		}
 	}
 
+	void GameState::nextPlayer()
+	{
+		m_hash ^= computeTurnHash();
+		m_numTurnPlayed++;
+		m_playerTurn = (m_playerTurn + 1) % 2;
+		m_hash ^= computeTurnHash();
+	}
+
+	void GameState::setPlayerTurn(u8 _player)
+	{
+		m_hash ^= computeTurnHash();
+		m_playerTurn = _player;
+		m_hash ^= computeTurnHash();
+	}
+
+	void GameState::setState(State _state)
+	{
+		m_hash ^= computeStateHash();
+		m_state = _state;
+		m_hash ^= computeStateHash();
+	}
+
 	SpecialAction GameState::pick(u32 _playableCardIndex)
 	{
 		DEBUG_ASSERT(_playableCardIndex < m_graph.m_numPlayableCards);
+		m_hash ^= computePlayableCardsHash();
 		u8 pickedCard = m_graph.m_playableCards[_playableCardIndex];
 		std::swap(m_graph.m_playableCards[_playableCardIndex], m_graph.m_playableCards[m_graph.m_numPlayableCards - 1]);
 		m_graph.m_numPlayableCards--;
 
 		unlinkNodeFromGraph(pickedCard);
+		m_hash ^= computePlayableCardsHash();
 
 		const Card& card = m_context->getCard(m_graph.m_graph[pickedCard].m_cardId);
 		m_playedAgeCards[m_numPlayedAgeCards++] = card.getAgeId();
 
 		auto& otherPlayer = m_playerCity[(m_playerTurn + 1) % 2];
+		const u8 otherPlayerGold = otherPlayer.m_gold; // only field of the opponent city that can change
 		u32 cost = getCurrentPlayerCity().computeCost(card, otherPlayer);
 
 		DEBUG_ASSERT(getCurrentPlayerCity().m_gold >= cost);
@@ -302,6 +441,9 @@ namespace sevenWD
 		updateMilitary(card.getMilitary(), getCurrentPlayerCity().ownScienceToken(ScienceToken::Strategy));
 
 		SpecialAction action = getCurrentPlayerCity().addCard(card, otherPlayer);
+		updateCityHash(m_playerTurn);
+		if (otherPlayer.m_gold != otherPlayerGold)
+			updateCityHash((m_playerTurn + 1) % 2);
 
 		if (abs(m_military) >= 9)
 			return SpecialAction::MilitaryWin;
@@ -312,30 +454,37 @@ namespace sevenWD
 	void GameState::burn(u32 _playableCardIndex)
 	{
 		DEBUG_ASSERT(_playableCardIndex < m_graph.m_numPlayableCards);
+		m_hash ^= computePlayableCardsHash();
 		u8 pickedCard = m_graph.m_playableCards[_playableCardIndex];
 		std::swap(m_graph.m_playableCards[_playableCardIndex], m_graph.m_playableCards[m_graph.m_numPlayableCards - 1]);
 		m_graph.m_numPlayableCards--;
 
 		unlinkNodeFromGraph(pickedCard);
+		m_hash ^= computePlayableCardsHash();
 		const Card& card = m_context->getCard(m_graph.m_graph[pickedCard].m_cardId);
 		m_playedAgeCards[m_numPlayedAgeCards++] = card.getAgeId();
 
 		// Track the discarded card for potential Mausoleum revival
+		m_hash ^= m_discardedCards.computeHash();
 		m_discardedCards.add(*m_context, card);
+		m_hash ^= m_discardedCards.computeHash();
 
 		u8 burnValue = 2 + getCurrentPlayerCity().m_numCardPerType[u32(CardType::Yellow)];
 		getCurrentPlayerCity().m_gold += burnValue;
+		updateCityHash(m_playerTurn);
 	}
 
 	SpecialAction GameState::buildWonder(u32 _withPlayableCardIndex, u32 _wondersIndex, u8 _additionalEffect)
 	{
 		DEBUG_ASSERT(_withPlayableCardIndex < m_graph.m_numPlayableCards);
 
+		m_hash ^= computePlayableCardsHash();
 		u8 pickedCard = m_graph.m_playableCards[_withPlayableCardIndex];
 		std::swap(m_graph.m_playableCards[_withPlayableCardIndex], m_graph.m_playableCards[m_graph.m_numPlayableCards - 1]);
 		m_graph.m_numPlayableCards--;
 
 		unlinkNodeFromGraph(pickedCard);
+		m_hash ^= computePlayableCardsHash();
 		const Card& card = m_context->getCard(m_graph.m_graph[pickedCard].m_cardId);
 		m_playedAgeCards[m_numPlayedAgeCards++] = card.getAgeId();
 
@@ -357,7 +506,9 @@ namespace sevenWD
 		{
 			const Card& destroyedCard = m_context->getCard(_additionalEffect);
 			// Track the destroyed card for potential Mausoleum revival
+			m_hash ^= m_discardedCards.computeHash();
 			m_discardedCards.add(*m_context, destroyedCard);
+			m_hash ^= m_discardedCards.computeHash();
 			otherPlayer.removeCard(destroyedCard);
 		}
 
@@ -368,7 +519,7 @@ namespace sevenWD
 		} 
 		else if (pickedWonder == Wonders::GreatLibrary)
 		{
-			if (!m_isDeterministic) {
+			if (!isDeterministic()) {
 				std::shuffle(m_scienceTokens.begin() + 5, m_scienceTokens.end(), m_context->rand());
 			}
 		}
@@ -378,6 +529,9 @@ namespace sevenWD
 		DEBUG_ASSERT((m_playerCity[0].m_unbuildWonderCount + m_playerCity[1].m_unbuildWonderCount) > 0);
 
 		SpecialAction action =  getCurrentPlayerCity().addCard(wonder, otherPlayer);
+		updateCityHash(0);
+		updateCityHash(1);
+
 		if (abs(m_military) >= 9)
 			return SpecialAction::MilitaryWin;
 		else
@@ -388,16 +542,21 @@ namespace sevenWD
 	{
 		ScienceToken pickedToken = m_scienceTokens[obtainedFromGreatLibrary ? (_tokenIndex + 5) : _tokenIndex];
 		if (!obtainedFromGreatLibrary) {
+			m_hash ^= computeScienceTokenHash();
 			std::swap(m_scienceTokens[_tokenIndex], m_scienceTokens[m_numScienceToken - 1]);
 			m_numScienceToken--;
+			m_hash ^= computeScienceTokenHash();
 		}
 
-		return getCurrentPlayerCity().addCard(m_context->getScienceToken(pickedToken), getOtherPlayerCity());
+		SpecialAction action = getCurrentPlayerCity().addCard(m_context->getScienceToken(pickedToken), getOtherPlayerCity());
+		updateCityHash(m_playerTurn);
+		return action;
 	}
 
 	void GameState::unlinkNodeFromGraph(u32 _nodeIndex)
 	{
 		DEBUG_ASSERT(m_graph.m_graph[_nodeIndex].m_child0 == CardNode::InvalidNode && m_graph.m_graph[_nodeIndex].m_child1 == CardNode::InvalidNode);
+		m_hash ^= computeNodeHash(_nodeIndex);
 
 		auto removeFromParent = [&](u8 parent)
 			{
@@ -410,8 +569,10 @@ namespace sevenWD
 					if (parentNode.m_child0 == CardNode::InvalidNode && parentNode.m_child1 == CardNode::InvalidNode)
 					{
 						if (parentNode.m_visible == 0) {
+							m_hash ^= computeNodeHash(parent);
 							pickCardAdnInitNode(parentNode, m_graph);
 							parentNode.m_visible = 1;
+							m_hash ^= computeNodeHash(parent);
 						}
 						m_graph.m_playableCards[m_graph.m_numPlayableCards++] = parent;
 					}
@@ -459,18 +620,21 @@ namespace sevenWD
 	{
 		if (m_graph.m_numPlayableCards == 0)
 		{
+			if (m_currentAge == 2)
+				return NextAge::EndGame;
+
+			m_hash ^= computeGraphHash() ^ computePlayableCardsHash();
 			if (m_currentAge == 0) {
 				initAge2();
 			} else if (m_currentAge == 1) {
 				initAge3();
-			} else if (m_currentAge == 2) {
-				return NextAge::EndGame;
 			}
+			m_hash ^= computeGraphHash() ^ computePlayableCardsHash();
 
 			if (m_military < 0) // player 1 is advanced in military, player 0 to play
-				m_playerTurn = 0;
+				setPlayerTurn(0);
 			else if (m_military > 0)
-				m_playerTurn = 1;
+				setPlayerTurn(1);
 			else
 				; // nothing to do, last player is the player to start the turn
 
@@ -525,109 +689,109 @@ namespace sevenWD
 		m_numScienceToken = 5; // 5 first tokens are used on the board
 	}
 
-	void GameState::initAge1Graph(bool makeDeterministic)
+	void GameState::initAge1Graph(GraphSetup& _graph, bool _makeDeterministic)
 	{
-		m_graphsPerAge[0].m_age = 0;
+		_graph.m_age = 0;
 
-		u32 end = genPyramidGraph(5, 0, m_graphsPerAge[0].m_graph);
-		m_graphsPerAge[0].m_numPlayableCards = 0;
+		u32 end = genPyramidGraph(5, 0, _graph.m_graph);
+		_graph.m_numPlayableCards = 0;
 		for (u32 i = 0; i < 6; ++i)
-			m_graphsPerAge[0].m_playableCards[m_graphsPerAge[0].m_numPlayableCards++] = u8(end - 6 + i);
+			_graph.m_playableCards[_graph.m_numPlayableCards++] = u8(end - 6 + i);
 
-		m_graphsPerAge[0].m_numAvailableGuildCards = 0;
-		m_graphsPerAge[0].m_numAvailableAgeCards = m_context->getAge1CardCount();
-		for (u32 i = 0; i < m_graphsPerAge[0].m_numAvailableAgeCards; ++i)
-			m_graphsPerAge[0].m_availableAgeCards[i] = u8(i);
+		_graph.m_numAvailableGuildCards = 0;
+		_graph.m_numAvailableAgeCards = m_context->getAge1CardCount();
+		for (u32 i = 0; i < _graph.m_numAvailableAgeCards; ++i)
+			_graph.m_availableAgeCards[i] = u8(i);
 
-		for (CardNode& node : m_graphsPerAge[0].m_graph)
+		for (CardNode& node : _graph.m_graph)
 		{
-			if (node.m_visible || makeDeterministic)
-				pickCardAdnInitNode(node, m_graphsPerAge[0]);
+			if (node.m_visible || _makeDeterministic)
+				pickCardAdnInitNode(node, _graph);
 		}
 	}
 
-	void GameState::initAge2Graph(bool makeDeterministic)
+	void GameState::initAge2Graph(GraphSetup& _graph, bool _makeDeterministic)
 	{
-		m_graphsPerAge[1].m_age = 1;
+		_graph.m_age = 1;
 
-		u32 end = genInversePyramidGraph(6, 5, 0, m_graphsPerAge[1].m_graph);
-		m_graphsPerAge[1].m_numPlayableCards = 0;
+		u32 end = genInversePyramidGraph(6, 5, 0, _graph.m_graph);
+		_graph.m_numPlayableCards = 0;
 		for (u32 i = 0; i < 2; ++i)
-			m_graphsPerAge[1].m_playableCards[m_graphsPerAge[1].m_numPlayableCards++] = u8(end - 2 + i);
+			_graph.m_playableCards[_graph.m_numPlayableCards++] = u8(end - 2 + i);
 
-		m_graphsPerAge[1].m_numAvailableAgeCards = m_context->getAge2CardCount();
-		for (u32 i = 0; i < m_graphsPerAge[1].m_numAvailableAgeCards; ++i)
-			m_graphsPerAge[1].m_availableAgeCards[i] = u8(i);
+		_graph.m_numAvailableAgeCards = m_context->getAge2CardCount();
+		for (u32 i = 0; i < _graph.m_numAvailableAgeCards; ++i)
+			_graph.m_availableAgeCards[i] = u8(i);
 		
-		for (CardNode& node : m_graphsPerAge[1].m_graph)
+		for (CardNode& node : _graph.m_graph)
 		{
-			if (node.m_visible || makeDeterministic)
-				pickCardAdnInitNode(node, m_graphsPerAge[1]);
+			if (node.m_visible || _makeDeterministic)
+				pickCardAdnInitNode(node, _graph);
 		}
 	}
 
-	void GameState::initAge3Graph(bool makeDeterministic)
+	void GameState::initAge3Graph(GraphSetup& _graph, bool _makeDeterministic)
 	{
-		m_graphsPerAge[2].m_age = 2;
+		_graph.m_age = 2;
 
-		u32 end = genPyramidGraph(3, 0, m_graphsPerAge[2].m_graph);
+		u32 end = genPyramidGraph(3, 0, _graph.m_graph);
 		const u32 connectNode0 = end;
 		const u32 connectNode1 = end + 1;
 
-		m_graphsPerAge[2].m_graph[connectNode0].m_visible = 0;
-		m_graphsPerAge[2].m_graph[connectNode1].m_visible = 0;
-		m_graphsPerAge[2].m_graph[connectNode0].m_isGuildCard = 0;
-		m_graphsPerAge[2].m_graph[connectNode1].m_isGuildCard = 0;
-		m_graphsPerAge[2].m_graph[connectNode0].m_cardId = CardNode::InvalidCardId;
-		m_graphsPerAge[2].m_graph[connectNode1].m_cardId = CardNode::InvalidCardId;
-
-		m_graphsPerAge[2].m_graph[connectNode0].m_parent0 = 5;
-		m_graphsPerAge[2].m_graph[connectNode0].m_parent1 = 6;
-		m_graphsPerAge[2].m_graph[5].m_child1 = connectNode0;
-		m_graphsPerAge[2].m_graph[6].m_child0 = connectNode0;
+		_graph.m_graph[connectNode0].m_visible = 0;
+		_graph.m_graph[connectNode1].m_visible = 0;
+		_graph.m_graph[connectNode0].m_isGuildCard = 0;
+		_graph.m_graph[connectNode1].m_isGuildCard = 0;
+		_graph.m_graph[connectNode0].m_cardId = CardNode::InvalidCardId;
+		_graph.m_graph[connectNode1].m_cardId = CardNode::InvalidCardId;
+
+		_graph.m_graph[connectNode0].m_parent0 = 5;
+		_graph.m_graph[connectNode0].m_parent1 = 6;
+		_graph.m_graph[5].m_child1 = connectNode0;
+		_graph.m_graph[6].m_child0 = connectNode0;
 		
-		m_graphsPerAge[2].m_graph[connectNode1].m_parent0 = 7;
-		m_graphsPerAge[2].m_graph[connectNode1].m_parent1 = 8;
-		m_graphsPerAge[2].m_graph[7].m_child1 = connectNode1;
-		m_graphsPerAge[2].m_graph[8].m_child0 = connectNode1;
+		_graph.m_graph[connectNode1].m_parent0 = 7;
+		_graph.m_graph[connectNode1].m_parent1 = 8;
+		_graph.m_graph[7].m_child1 = connectNode1;
+		_graph.m_graph[8].m_child0 = connectNode1;
 
-		end = genInversePyramidGraph(4, 3, end + 2, m_graphsPerAge[2].m_graph);
+		end = genInversePyramidGraph(4, 3, end + 2, _graph.m_graph);
 
-		m_graphsPerAge[2].m_graph[connectNode0].m_child0 = 11;
-		m_graphsPerAge[2].m_graph[connectNode0].m_child1 = 12;
-		m_graphsPerAge[2].m_graph[11].m_parent1 = connectNode0;
-		m_graphsPerAge[2].m_graph[12].m_parent0 = connectNode0;
+		_graph.m_graph[connectNode0].m_child0 = 11;
+		_graph.m_graph[connectNode0].m_child1 = 12;
+		_graph.m_graph[11].m_parent1 = connectNode0;
+		_graph.m_graph[12].m_parent0 = connectNode0;
 
-		m_graphsPerAge[2].m_graph[connectNode1].m_child0 = 13;
-		m_graphsPerAge[2].m_graph[connectNode1].m_child1 = 14;
-		m_graphsPerAge[2].m_graph[13].m_parent1 = connectNode1;
-		m_graphsPerAge[2].m_graph[14].m_parent0 = connectNode1;
+		_graph.m_graph[connectNode1].m_child0 = 13;
+		_graph.m_graph[connectNode1].m_child1 = 14;
+		_graph.m_graph[13].m_parent1 = connectNode1;
+		_graph.m_graph[14].m_parent0 = connectNode1;
 
 		// assign randomely guild cards tag
-		std::vector<u8> guildCarTag(m_graphsPerAge[2].m_graph.size(), 0);
+		std::array<u8, std::tuple_size_v<GraphArray>> guildCarTag = {};
 		guildCarTag[0] = 1;
 		guildCarTag[1] = 1;
 		guildCarTag[2] = 1;
 		std::shuffle(guildCarTag.begin(), guildCarTag.end(), m_context->rand());
-		for (u32 i = 0; i < m_graphsPerAge[2].m_graph.size(); ++i)
-			m_graphsPerAge[2].m_graph[i].m_isGuildCard = guildCarTag[i];
+		for (u32 i = 0; i < _graph.m_graph.size(); ++i)
+			_graph.m_graph[i].m_isGuildCard = guildCarTag[i];
 
-		m_graphsPerAge[2].m_numPlayableCards = 0;
+		_graph.m_numPlayableCards = 0;
 		for (u32 i = 0; i < 2; ++i)
-			m_graphsPerAge[2].m_playableCards[m_graphsPerAge[2].m_numPlayableCards++] = u8(end - 2 + i);
+			_graph.m_playableCards[_graph.m_numPlayableCards++] = u8(end - 2 + i);
 
-		m_graphsPerAge[2].m_numAvailableAgeCards = m_context->getAge3CardCount();
-		m_graphsPerAge[2].m_numAvailableGuildCards = m_context->getGuildCardCount();
+		_graph.m_numAvailableAgeCards = m_context->getAge3CardCount();
+		_graph.m_numAvailableGuildCards = m_context->getGuildCardCount();
 
-		for (u32 i = 0; i < m_graphsPerAge[2].m_numAvailableAgeCards; ++i)
-			m_graphsPerAge[2].m_availableAgeCards[i] = u8(i);
-		for (u32 i = 0; i < m_graphsPerAge[2].m_numAvailableGuildCards; ++i)
-			m_graphsPerAge[2].m_availableGuildCards[i] = u8(i);
+		for (u32 i = 0; i < _graph.m_numAvailableAgeCards; ++i)
+			_graph.m_availableAgeCards[i] = u8(i);
+		for (u32 i = 0; i < _graph.m_numAvailableGuildCards; ++i)
+			_graph.m_availableGuildCards[i] = u8(i);
 		
-		for (CardNode& node : m_graphsPerAge[2].m_graph)
+		for (CardNode& node : _graph.m_graph)
 		{
-			if (node.m_visible || makeDeterministic)
-				pickCardAdnInitNode(node, m_graphsPerAge[2]);
+			if (node.m_visible || _makeDeterministic)
+				pickCardAdnInitNode(node, _graph);
 		}
 	}
 
@@ -635,10 +799,11 @@ namespace sevenWD
 	{
 		m_currentAge = 0;
 
-		if (!m_isDeterministic)
-			initAge1Graph(false);
+		if (isDeterministic())
+			m_graph = m_pDeterminizedSetup->m_graphsPerAge[0];
+		else
+			initAge1Graph(m_graph, false);
 
-		m_graph = m_graphsPerAge[0];
 		m_numPlayedAgeCards = 0;
 
 	}
@@ -647,10 +812,11 @@ namespace sevenWD
 	{
 		m_currentAge = 1;
 
-		if (!m_isDeterministic)
-			initAge2Graph(false);
+		if (isDeterministic())
+			m_graph = m_pDeterminizedSetup->m_graphsPerAge[1];
+		else
+			initAge2Graph(m_graph, false);
 
-		m_graph = m_graphsPerAge[1];
 		m_numPlayedAgeCards = 0;
 	}
 
@@ -658,10 +824,11 @@ namespace sevenWD
 	{
 		m_currentAge = 2;
 
-		if (!m_isDeterministic)
-			initAge3Graph(false);
+		if (isDeterministic())
+			m_graph = m_pDeterminizedSetup->m_graphsPerAge[2];
+		else
+			initAge3Graph(m_graph, false);
 
-		m_graph = m_graphsPerAge[2];
 		m_numPlayedAgeCards = 0;
 	}
 
@@ -842,84 +1009,87 @@ namespace sevenWD
 		return out;
 	}
 
+	namespace
+	{
+		// Order of the N resources starting at _first by decreasing price, ties keep the resource order.
+		// Same result as a stable sort, computed from pairwise comparisons so there is no data dependent branch.
+		template<u32 N>
+		std::array<u8, N> sortResourcesByPrice(const std::array<u8, u32(RT::Count)>& _prices, u32 _first)
+		{
+			std::array<u8, N> order;
+			for (u32 i = 0; i < N; ++i)
+			{
+				u32 rank = 0;
+				for (u32 j = 0; j < i; ++j)
+					rank += _prices[_first + j] >= _prices[_first + i];
+				for (u32 j = i + 1; j < N; ++j)
+					rank += _prices[_first + j] > _prices[_first + i];
+				order[rank] = u8(_first + i);
+			}
+			return order;
+		}
+
+		// Greedily remove up to _numFree resources from _cost, following _order
+		template<size_t N>
+		void spendFreeResources(std::array<u8, u32(RT::Count)>& _cost, const std::array<u8, N>& _order, u32 _numFree)
+		{
+			for (u8 r : _order)
+			{
+				u32 spent = std::min<u32>(_numFree, _cost[r]);
+				_cost[r] = u8(_cost[r] - spent);
+				_numFree -= spent;
+			}
+		}
+	}
+
+	PlayerCity::ResourcePrices PlayerCity::computeResourcePrices(const PlayerCity& _otherPlayer) const
+	{
+		ResourcePrices prices;
+		for (u32 i = 0; i < u32(RT::Count); ++i)
+			prices.m_goldCostPerResource[i] = m_resourceDiscount[i] ? 1 : u8(2 + _otherPlayer.m_production[i]);
+
+		prices.m_normalResourceOrder = sortResourcesByPrice<3>(prices.m_goldCostPerResource, u32(RT::FirstBrown));
+		prices.m_rareResourceOrder = sortResourcesByPrice<2>(prices.m_goldCostPerResource, u32(RT::FirstGrey));
+		prices.m_allResourceOrder = sortResourcesByPrice<u32(RT::Count)>(prices.m_goldCostPerResource, 0);
+		return prices;
+	}
+
 	u32 PlayerCity::computeCost(const Card& _card, const PlayerCity& _otherPlayer) const
+	{
+		return computeCost(_card, computeResourcePrices(_otherPlayer));
+	}
+
+	u32 PlayerCity::computeCost(const Card& _card, const ResourcePrices& _prices) const
 	{
 		if (_card.m_chainIn != ChainingSymbol::None && m_chainingSymbols & (1u << u32(_card.m_chainIn)))
 			return 0;
 
-		std::array<u8, u32(RT::Count)> goldCostPerResource = { 2,2,2,2,2 }; // base cost
+		std::array<u8, u32(RT::Count)> cardResourceCost;
+		u32 missingResources = 0;
 		for (u32 i = 0; i < u32(RT::Count); ++i)
 		{
-			goldCostPerResource[i] += _otherPlayer.m_production[i];
-			goldCostPerResource[i] = m_resourceDiscount[i] ? 1 : goldCostPerResource[i];
+			cardResourceCost[i] = Helper::safeSub(_card.m_cost[i], m_production[i]);
+			missingResources += cardResourceCost[i];
 		}
 
-		std::array<u8, u32(RT::Count)> cardResourceCost = _card.m_cost;
-		bool empty = true;
-		for (u32 i = 0; i < u32(RT::Count); ++i)
+		if (missingResources == 0)
+			return _card.m_goldCost;
+
+		if (ownScienceToken(ScienceToken::Masonry) && _card.m_type == CardType::Blue ||
+			ownScienceToken(ScienceToken::Architecture) && _card.m_type == CardType::Wonder)
 		{
-			cardResourceCost[i] = Helper::safeSub(cardResourceCost[i], m_production[i]);
-			empty &= cardResourceCost[i] == 0;
+			spendFreeResources(cardResourceCost, _prices.m_allResourceOrder, 2);
 		}
-		
-		if (!empty)
-		{
-			ResourceType normalResources[] = { RT::Wood, RT::Clay, RT::Stone };
-			ResourceType rareResources[] = { RT::Glass, RT::Papyrus };
-			std::sort(std::begin(normalResources), std::end(normalResources), [&](ResourceType _1, ResourceType _2) { return goldCostPerResource[u32(_1)] > goldCostPerResource[u32(_2)]; });
-			std::sort(std::begin(rareResources), std::end(rareResources), [&](ResourceType _1, ResourceType _2) { return goldCostPerResource[u32(_1)] > goldCostPerResource[u32(_2)]; });
-			
-
-			if (ownScienceToken(ScienceToken::Masonry) && _card.m_type == CardType::Blue ||
-				ownScienceToken(ScienceToken::Architecture) && _card.m_type == CardType::Wonder)
-			{
-				ResourceType allResources[] = { RT::Wood, RT::Clay, RT::Stone, RT::Glass, RT::Papyrus };
-				std::sort(std::begin(allResources), std::end(allResources), [&](ResourceType _1, ResourceType _2) { return goldCostPerResource[u32(_1)] > goldCostPerResource[u32(_2)]; });
-
-				u32 freeResources = 2;
-				for (ResourceType r : allResources)
-				{
-					while (freeResources > 0 && cardResourceCost[u32(r)] > 0)
-					{
-						cardResourceCost[u32(r)]--;
-						freeResources--;
-					}
-				}
-			}
-
-			// first spend normal resource
-			for (u32 i = 0; i < m_weakProduction.first; ++i)
-			{
-				for (ResourceType r : normalResources)
-				{
-					if (cardResourceCost[u32(r)] > 0)
-					{
-						cardResourceCost[u32(r)]--;
-						break;
-					}
-				}
-			}
 
-			// then same for rare resource
-			for (u32 i = 0; i < m_weakProduction.second; ++i)
-			{
-				for (ResourceType r : rareResources)
-				{
-					if (cardResourceCost[u32(r)] > 0)
-					{
-						cardResourceCost[u32(r)]--;
-						break;
-					}
-				}
-			}
+		// first spend normal resource, then same for rare resource
+		spendFreeResources(cardResourceCost, _prices.m_normalResourceOrder, m_weakProduction.first);
+		spendFreeResources(cardResourceCost, _prices.m_rareResourceOrder, m_weakProduction.second);
 
-			u32 finalCost = 0;
-			for (u32 i = 0; i < u32(RT::Count); ++i)
-				finalCost += cardResourceCost[i] * goldCostPerResource[i];
+		u32 finalCost = 0;
+		for (u32 i = 0; i < u32(RT::Count); ++i)
+			finalCost += cardResourceCost[i] * _prices.m_goldCostPerResource[i];
 
-			return finalCost + _card.m_goldCost;
-		}
-	 return _card.m_goldCost;
+		return finalCost + _card.m_goldCost;
 	}
 
 	SpecialAction PlayerCity::addCard(const Card& _card, const PlayerCity& _otherCity)
@@ -1469,7 +1639,7 @@ namespace sevenWD
 		}
 	}
 
-	void DiscardedCards::getRevivableCards(std::vector<u8>& outCardIds) const
+	void DiscardedCards::getRevivableCards(RevivableCardList& outCardIds) const
 	{
 		outCardIds.clear();
 
@@ -6,6 +6,7 @@
 #include <algorithm>
 
 #include "GameContext.h"
+#include "Core/FixedVector.h"
 
 namespace sevenWD
 {
@@ -34,12 +35,25 @@ namespace sevenWD
 				index = u8(-1);
 		}
 
+		// Gold price of each resource bought from the bank and order in which free resources are assigned (most expensive first).
+		// Only depends on both cities, compute it once to evaluate several cards of the same position.
+		struct ResourcePrices
+		{
+			std::array<u8, u32(ResourceType::Count)> m_goldCostPerResource;
+			std::array<u8, 3> m_normalResourceOrder; // Wood, Clay, Stone
+			std::array<u8, 2> m_rareResourceOrder; // Glass, Papyrus
+			std::array<u8, u32(ResourceType::Count)> m_allResourceOrder;
+		};
+		ResourcePrices computeResourcePrices(const PlayerCity& _otherPlayer) const;
+
 		u32 computeCost(const Card& _card, const PlayerCity& _otherPlayer) const;
+		u32 computeCost(const Card& _card, const ResourcePrices& _prices) const;
 		SpecialAction addCard(const Card& _card, const PlayerCity& _otherCity);
 		void removeCard(const Card& _card);
 
 		bool ownScienceToken(ScienceToken _token) const { return ((1u << u32(_token)) & m_ownedScienceTokens) > 0; }
 		u32 computeVictoryPoint(const PlayerCity& _otherCity, bool includeGoldVP) const;
+		u64 computeHash(u32 _player) const;
 
 		void print();
 	};
@@ -68,13 +82,18 @@ namespace sevenWD
 		// Yellow cards with setGoldRewardForCardColorCount: track all unique (5 in game: Armurerie, Phare, Port, ChambreDeCommerce, Arene)
 		std::array<u8, 5> yellowGoldPerCardTypeCardIds;
 		u8 numYellowGoldPerCardTypeCards = 0;
+
+		// One entry per tracked card above
+		static constexpr u32 cMaxRevivableCards = u32(ResourceType::Count) + 2 + u32(ScienceSymbol::Count) + 7 + 3 + 4 + 5;
+		using RevivableCardList = core::FixedVector<u8, cMaxRevivableCards>;
 	
 		DiscardedCards();
 		void add(const GameContext& context, const Card& card);
 		
 		// Get list of all revivable card IDs (no duplicates, only best choices)
-		void getRevivableCards(std::vector<u8>& outCardIds) const;
+		void getRevivableCards(RevivableCardList& outCardIds) const;
 		bool hasRevivableCards() const;
+		u64 computeHash() const;
 	};
 
 	//----------------------------------------------------------------------------
@@ -103,7 +122,17 @@ namespace sevenWD
 		GameState(GameState&&) = default;
 		GameState& operator=(GameState&&) = default;
 
-		void makeDeterministic();
+		// Fixes the hidden cards. The future ages go to _setup, which must outlive this state and every state copied from
+		// it: the search owning the root keeps it next to its nodes.
+		struct DeterminizedSetup;
+		void makeDeterministic(DeterminizedSetup& _setup);
+		bool isDeterministic() const { return m_pDeterminizedSetup != nullptr; }
+
+		// Everything an action can modify, restored by undo(). Graph nodes are saved individually (only the parents
+		// of the removed card can change) except around an age transition where the whole graph is swapped.
+		struct UndoRecord;
+		void saveUndoRecord(UndoRecord& _record, u8 _playableCardIndex) const;
+		void undo(const UndoRecord& _record);
 
 		enum class NextAge
 		{
@@ -115,7 +144,7 @@ namespace sevenWD
 		NextAge nextAge();
 		u32 getCurrentPlayerTurn() const { return m_playerTurn; }
 		u8 getNumTurnPlayed() const { return m_numTurnPlayed; }
-		void nextPlayer() { m_numTurnPlayed++; m_playerTurn = (m_playerTurn + 1) % 2; }
+		void nextPlayer();
 
 		const Card& getPlayableCard(u32 _index) const;
 		const Card& getPlayableScienceToken(u32 _index, bool isGreatLibraryDraft) const;
@@ -157,6 +186,11 @@ namespace sevenWD
 
 		int getMilitary() const { return m_military; }
 
+		// Zobrist key of the position, updated incrementally by every action (see GameStateHash.cpp)
+		u64 getHash() const { return m_hash; }
+		u64 computeHash() const;
+		void initHash(); // full recompute, to call after editing the state directly
+
 		// Added getters for persistent military-token flags so const accessors are available
 		bool getMilitaryToken2(u32 player) const { return militaryToken2[player]; }
 		bool getMilitaryToken5(u32 player) const { return militaryToken5[player]; }
@@ -181,7 +215,6 @@ namespace sevenWD
 		std::array<PlayerCity, 2> m_playerCity;
 		std::array<ScienceToken, u8(ScienceToken::Count)> m_scienceTokens;
 		u8 m_numScienceToken = 0;
-		bool m_isDeterministic = false;
 		State m_state = State::DraftWonder;
 
 		// Each graph a pre-determined if gameState is deterministic
@@ -197,9 +230,17 @@ namespace sevenWD
 			u8 m_numAvailableAgeCards = 0;
 			u8 m_numAvailableGuildCards = 0;
 		};
-		GraphSetup m_graphsPerAge[3]; // one per age
 		GraphSetup m_graph; // active graph
 
+		// Graphs of the future ages, fixed by makeDeterministic() and never modified afterward so every state copied from
+		// a deterministic state shares them. Non deterministic states generate each age graph when it starts.
+		// A plain pointer: copying a state must not touch a reference count shared by the threads of a search.
+		struct DeterminizedSetup
+		{
+			GraphSetup m_graphsPerAge[3] = {}; // one per age
+		};
+		const DeterminizedSetup* m_pDeterminizedSetup = nullptr;
+
 #ifdef _DEBUG
 		const Card* m_playableCardsPtr[6];
 #endif
@@ -222,9 +263,48 @@ namespace sevenWD
 		u8 m_currentDraftRound = 0; // 0 = first round, 1 = second round, 2 = finished
 		u8 m_picksInCurrentRound = 0;
 
+		u64 m_hash = 0;
+		std::array<u64, 2> m_cityHash = {}; // part of m_hash contributed by each city
+
 		// Helper to get revivable cards for Mausoleum
 		const DiscardedCards& getDiscardedCards() const { return m_discardedCards; }
 
+		struct UndoRecord
+		{
+			std::array<PlayerCity, 2> m_playerCity = { PlayerCity(nullptr), PlayerCity(nullptr) };
+			DiscardedCards m_discardedCards;
+			std::array<ScienceToken, u8(ScienceToken::Count)> m_scienceTokens;
+			std::array<Wonders, u32(Wonders::Count)> m_wonderDraftPool;
+			u64 m_hash;
+			std::array<u64, 2> m_cityHash;
+
+			State m_state;
+			u8 m_numScienceToken;
+			u8 m_numPlayedAgeCards;
+			u8 m_playedAgeCard; // previous value of m_playedAgeCards[m_numPlayedAgeCards]
+			u8 m_numTurnPlayed;
+			u8 m_playerTurn;
+			u8 m_currentAge;
+			int8_t m_military;
+			bool militaryToken2[2];
+			bool militaryToken5[2];
+			u8 m_currentDraftRound;
+			u8 m_picksInCurrentRound;
+
+			// Graph
+			std::array<u8, 2> m_parentIndex; // CardNode::InvalidNode if unused
+			std::array<CardNode, 2> m_parentNode;
+			std::array<u8, 6> m_playableCards;
+			std::array<u8, 23> m_availableAgeCards;
+			std::array<u8, 7> m_availableGuildCards;
+			u8 m_numPlayableCards;
+			u8 m_numAvailableAgeCards;
+			u8 m_numAvailableGuildCards;
+
+			bool m_hasFullGraph;
+			GraphSetup m_graph;
+		};
+
 	private:
 		u32 genPyramidGraph(u32 _numRow, u32 _startNodeIndex, GraphArray& graph);
 		u32 genInversePyramidGraph(u32 _baseSize, u32 _numRow, u32 _startNodeIndex, GraphArray& graph);
@@ -234,11 +314,23 @@ namespace sevenWD
 		const PlayerCity& getOtherPlayerCity() const { return m_playerCity[(m_playerTurn + 1) % 2]; }
 		void unlinkNodeFromGraph(u32 _nodeIndex);
 		void updateMilitary(u8 military, bool hasStrategyToken);
+		void setPlayerTurn(u8 _player);
+		void setState(State _state);
+
+		void updateCityHash(u32 _player);
+		u64 computeTurnHash() const;
+		u64 computeStateHash() const;
+		u64 computeMilitaryHash() const;
+		u64 computeScienceTokenHash() const;
+		u64 computeDraftHash() const;
+		u64 computeNodeHash(u32 _nodeIndex) const;
+		u64 computeGraphHash() const;
+		u64 computePlayableCardsHash() const;
 
 		void initScienceTokens();
-		void initAge1Graph(bool makeDeterministic);
-		void initAge2Graph(bool makeDeterministic);
-		void initAge3Graph(bool makeDeterministic);
+		void initAge1Graph(GraphSetup& _graph, bool _makeDeterministic);
+		void initAge2Graph(GraphSetup& _graph, bool _makeDeterministic);
+		void initAge3Graph(GraphSetup& _graph, bool _makeDeterministic);
 
 		void initAge1();
 		void initAge2();
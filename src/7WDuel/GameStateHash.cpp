@@ -0,0 +1,245 @@
+#include "7WDuel/GameEngine.h"
+
+#include <cstring>
+#include <type_traits>
+
+namespace sevenWD
+{
+	// Zobrist keys of a GameState.
+	// Only information visible to both players is hashed: hidden graph nodes contribute the same key whatever card
+	// a determinization put behind them, so all determinizations of a position share the same key.
+	// Lists indexed by moves (playable cards, science tokens, wonder draft, unbuilt wonders) are hashed by position
+	// since the same move index must refer to the same action for two positions with the same key.
+	namespace
+	{
+		constexpr u32 MaxCardId = 128;
+		constexpr u32 MaxGraphNodes = 20;
+		constexpr u32 MilitaryOffset = 32;
+
+		struct ZobristKeys
+		{
+			u64 m_playerTurn;
+			u64 m_numTurnPlayed[256];
+			u64 m_state[8];
+			u64 m_age[4];
+			u64 m_military[2 * MilitaryOffset];
+			u64 m_militaryToken2[2];
+			u64 m_militaryToken5[2];
+			u64 m_boardScienceToken[5][u32(ScienceToken::Count)];
+			u64 m_greatLibraryToken[3][u32(ScienceToken::Count)];
+			u64 m_draftWonder[4][u32(Wonders::Count)];
+			u64 m_hiddenNode[MaxGraphNodes];
+			u64 m_visibleNode[MaxGraphNodes][MaxCardId];
+			u64 m_playableSlot[6][MaxGraphNodes];
+
+			u64 m_city[2];
+			u64 m_discardedCards;
+
+			ZobristKeys()
+			{
+				// splitmix64 with a fixed seed so keys are stable across runs (dataset dedup relies on it)
+				u64 state = 0x7D0E1C0DE5EED5ull;
+				u64* keys = reinterpret_cast<u64*>(this);
+				for (size_t i = 0; i < sizeof(ZobristKeys) / sizeof(u64); ++i)
+				{
+					u64 z = (state += 0x9E3779B97F4A7C15ull);
+					z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+					z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+					keys[i] = z ^ (z >> 31);
+				}
+			}
+		};
+
+		const ZobristKeys& getKeys()
+		{
+			static const ZobristKeys s_keys;
+			return s_keys;
+		}
+
+		template<size_t N>
+		u64 getKey(const u64(&_keys)[N], u32 _index)
+		{
+			DEBUG_ASSERT(_index < N);
+			return _keys[_index];
+		}
+
+		// Cities and discarded cards are made of many small counters updated together by addCard(), they are packed
+		// and mixed as a whole instead of maintaining one key per counter
+		template<size_t N>
+		u64 hashBytes(u64 _seed, const u8(&_bytes)[N])
+		{
+			u64 words[(N + 7) / 8] = {};
+			memcpy(words, _bytes, N);
+
+			u64 hash = _seed;
+			for (u64 word : words)
+			{
+				hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+				hash ^= hash >> 29;
+			}
+			hash *= 0xBF58476D1CE4E5B9ull;
+			return hash ^ (hash >> 32);
+		}
+
+		template<typename T>
+		u8* packBytes(u8* _dst, const T& _value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			memcpy(_dst, &_value, sizeof(T));
+			return _dst + sizeof(T);
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	u64 PlayerCity::computeHash(u32 _player) const
+	{
+		// Wonders are compared by position, entries past m_unbuildWonderCount are stale
+		std::array<Wonders, 4> unbuildWonders;
+		unbuildWonders.fill(Wonders::Count);
+		std::copy_n(m_unbuildWonders.begin(), m_unbuildWonderCount, unbuildWonders.begin());
+
+		u8 bytes[64] = {};
+		u8* dst = bytes;
+		dst = packBytes(dst, m_chainingSymbols);
+		dst = packBytes(dst, m_ownedGuildCards);
+		dst = packBytes(dst, m_ownedScienceTokens);
+		dst = packBytes(dst, m_gold);
+		dst = packBytes(dst, m_victoryPoints);
+		dst = packBytes(dst, m_numScienceSymbols);
+		dst = packBytes(dst, m_weakProduction.first);
+		dst = packBytes(dst, m_weakProduction.second);
+		dst = packBytes(dst, m_ownedScienceSymbol);
+		dst = packBytes(dst, m_numCardPerType);
+		dst = packBytes(dst, m_production);
+		dst = packBytes(dst, m_resourceDiscount);
+		dst = packBytes(dst, m_bestProductionCardId);
+		dst = packBytes(dst, unbuildWonders);
+		DEBUG_ASSERT(dst <= std::end(bytes));
+
+		return hashBytes(getKeys().m_city[_player], bytes);
+	}
+
+	//----------------------------------------------------------------------------
+	u64 DiscardedCards::computeHash() const
+	{
+		static_assert(std::is_trivially_copyable_v<DiscardedCards> && sizeof(DiscardedCards) <= 64);
+
+		u8 bytes[sizeof(DiscardedCards)];
+		memcpy(bytes, this, sizeof(DiscardedCards));
+		return hashBytes(getKeys().m_discardedCards, bytes);
+	}
+
+	//----------------------------------------------------------------------------
+	u64 GameState::computeHash() const
+	{
+		return computeTurnHash() ^ computeStateHash() ^ computeMilitaryHash() ^ computeScienceTokenHash() ^ computeDraftHash()
+			^ computeGraphHash() ^ computePlayableCardsHash() ^ m_discardedCards.computeHash()
+			^ m_playerCity[0].computeHash(0) ^ m_playerCity[1].computeHash(1);
+	}
+
+	void GameState::initHash()
+	{
+		m_cityHash[0] = m_playerCity[0].computeHash(0);
+		m_cityHash[1] = m_playerCity[1].computeHash(1);
+		m_hash = computeHash();
+	}
+
+	void GameState::updateCityHash(u32 _player)
+	{
+		u64 cityHash = m_playerCity[_player].computeHash(_player);
+		m_hash ^= m_cityHash[_player] ^ cityHash;
+		m_cityHash[_player] = cityHash;
+	}
+
+	u64 GameState::computeTurnHash() const
+	{
+		const ZobristKeys& keys = getKeys();
+		return (m_playerTurn ? keys.m_playerTurn : 0) ^ keys.m_numTurnPlayed[m_numTurnPlayed];
+	}
+
+	u64 GameState::computeStateHash() const
+	{
+		const ZobristKeys& keys = getKeys();
+		u64 hash = getKey(keys.m_state, u32(m_state));
+
+		// Great library draft is only revealed while the player is picking from it
+		if (m_state == State::GreatLibraryToken || m_state == State::GreatLibraryTokenThenReplay)
+		{
+			for (u32 i = 0; i < 3; ++i)
+				hash ^= keys.m_greatLibraryToken[i][u32(m_scienceTokens[i + 5])];
+		}
+		return hash;
+	}
+
+	u64 GameState::computeMilitaryHash() const
+	{
+		const ZobristKeys& keys = getKeys();
+		u64 hash = getKey(keys.m_military, u32(m_military + i32(MilitaryOffset)));
+		for (u32 i = 0; i < 2; ++i)
+		{
+			hash ^= militaryToken2[i] ? keys.m_militaryToken2[i] : 0;
+			hash ^= militaryToken5[i] ? keys.m_militaryToken5[i] : 0;
+		}
+		return hash;
+	}
+
+	u64 GameState::computeScienceTokenHash() const
+	{
+		const ZobristKeys& keys = getKeys();
+		u64 hash = 0;
+		for (u32 i = 0; i < m_numScienceToken; ++i)
+			hash ^= keys.m_boardScienceToken[i][u32(m_scienceTokens[i])];
+		return hash;
+	}
+
+	u64 GameState::computeDraftHash() const
+	{
+		if (!isDraftingWonders())
+			return 0;
+
+		const ZobristKeys& keys = getKeys();
+		u64 hash = 0;
+		for (u32 i = 0; i < getNumDraftableWonders(); ++i)
+			hash ^= keys.m_draftWonder[i][u32(getDraftableWonder(i))];
+		return hash;
+	}
+
+	u64 GameState::computeNodeHash(u32 _nodeIndex) const
+	{
+		const ZobristKeys& keys = getKeys();
+		const CardNode& node = m_graph.m_graph[_nodeIndex];
+		return node.m_visible ? getKey(keys.m_visibleNode[_nodeIndex], node.m_cardId) : keys.m_hiddenNode[_nodeIndex];
+	}
+
+	u64 GameState::computeGraphHash() const
+	{
+		// Graph is not initialized before the end of the wonder draft
+		if (m_currentAge > 2)
+			return 0;
+
+		u64 hash = getKeys().m_age[m_currentAge];
+		for (u32 i = 0; i < MaxGraphNodes; ++i)
+		{
+			const CardNode& node = m_graph.m_graph[i];
+			bool isRemoved = node.m_child0 == CardNode::InvalidNode && node.m_child1 == CardNode::InvalidNode;
+			for (u32 j = 0; isRemoved && j < m_graph.m_numPlayableCards; ++j)
+				isRemoved = m_graph.m_playableCards[j] != i;
+
+			if (!isRemoved)
+				hash ^= computeNodeHash(i);
+		}
+		return hash;
+	}
+
+	u64 GameState::computePlayableCardsHash() const
+	{
+		if (m_currentAge > 2)
+			return 0;
+
+		const ZobristKeys& keys = getKeys();
+		u64 hash = 0;
+		for (u32 i = 0; i < m_graph.m_numPlayableCards; ++i)
+			hash ^= keys.m_playableSlot[i][m_graph.m_playableCards[i]];
+		return hash;
+	}
+}
@@ -181,8 +181,9 @@ namespace sevenWD::Helper
 				writeLE(g.m_numAvailableGuildCards);
 			};
 
+		// Graphs of the future ages, only known by deterministic states (kept in version 3 layout)
 		for (u32 a = 0; a < 3; ++a)
-			writeGraphSetup(_state.m_graphsPerAge[a]);
+			writeGraphSetup(_state.isDeterministic() ? _state.m_pDeterminizedSetup->m_graphsPerAge[a] : GameState::GraphSetup{});
 
 		// active graph
 		writeGraphSetup(_state.m_graph);
@@ -402,8 +403,12 @@ namespace sevenWD::Helper
 			return true;
 			};
 
+		// Graphs of the future ages are not restored, the state is not deterministic
 		for (u32 a = 0; a < 3; ++a)
-			if (!readGraphSetup(_outState.m_graphsPerAge[a])) return false;
+		{
+			GameState::GraphSetup futureGraph;
+			if (!readGraphSetup(futureGraph)) return false;
+		}
 
 		if (!readGraphSetup(_outState.m_graph)) return false;
 
@@ -412,8 +417,9 @@ namespace sevenWD::Helper
 		for (auto& city : _outState.m_playerCity)
 			city.m_context = &_context;
 
-		// mark deterministic false (not serialized)
-		_outState.m_isDeterministic = false;
+		// future ages are not serialized
+		_outState.m_pDeterminizedSetup = nullptr;
+		_outState.initHash();
 
 		return true;
 	}
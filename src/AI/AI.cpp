@@ -80,7 +80,7 @@ namespace sevenWD
 	std::pair<Move, float> MonteCarloAI::selectMove(const GameContext& _sevenWDContext, const GameController& _game, const std::vector<Move>& _moves, void* pThreadContext) {
 		std::vector<u32> numWins(_moves.size());
 
-		std::vector<Move> curMoves;
+		GameController::MoveList curMoves;
 		for (u32 i = 0; i < _moves.size(); ++i) {
 			for (u32 j = 0; j < m_numSimu; ++j) {
 				GameController game = _game;
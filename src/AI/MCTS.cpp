@@ -1,5 +1,5 @@
 #include "MCTS.h"
-#include "Core/thread_pool.h"
+#include "Core/Scheduler.h"
 
 // --------------------------------------------- //
 // ---------------- MCTS_Simple ---------------- //
@@ -9,7 +9,7 @@ std::pair<sevenWD::Move, float> MCTS_Simple::selectMove(const sevenWD::GameConte
 	using namespace sevenWD;
 
 	std::vector<float> scores(_moves.size());
-	std::vector<Move> curMoves;
+	GameController::MoveList curMoves;
 	unsigned int rootPlayer = _game.m_gameState.getCurrentPlayerTurn();
 
 	for (u32 i = 0; i < _moves.size(); ++i) {
@@ -47,15 +47,306 @@ std::pair<sevenWD::Move, float> MCTS_Simple::selectMove(const sevenWD::GameConte
 }
 
 // --------------------------------------------------- //
-// ---------------- MCTS_Deterministic --------------- //
+// ------------------ MCTS_TreeCache ----------------- //
 // --------------------------------------------------- //
-MCTS_Deterministic::MCTS_Deterministic(u32 numMoves, u32 numGameState, bool mt) : BaseNetworkAI("MCTS_Deterministic", {}), m_numMoves(numMoves), m_numSampling(numGameState)
+void MCTS_TreeCache::resize(u32 numTrees)
 {
-	if (mt) {
-		m_threadPool = new thread_pool(std::thread::hardware_concurrency());
+	for (u32 i = numTrees; i < m_trees.size(); ++i) {
+		dropTree(m_trees[i]);
+	}
+	m_trees.resize(numTrees);
+}
+
+void MCTS_TreeCache::clear()
+{
+	for (Tree& tree : m_trees) {
+		dropTree(tree);
+	}
+	m_trees.clear();
+}
+
+void MCTS_TreeCache::dropTree(Tree& tree)
+{
+	if (tree.m_pRoot) {
+		tree.m_pRoot->cleanup();
+		tree.m_pRoot = nullptr;
+	}
+	if (tree.m_allocator) {
+		// keep the pages for the next search, unless the tree grew beyond the budget
+		if (tree.m_allocator->getUsedSize() > cMaxTreeSize) {
+			tree.m_allocator.reset();
+		}
+		else {
+			tree.m_allocator->reset();
+		}
+	}
+}
+
+core::LinearAllocator& MCTS_TreeCache::getAllocator(u32 i)
+{
+	Tree& tree = m_trees[i];
+	if (!tree.m_allocator) {
+		tree.m_allocator = std::make_unique<core::LinearAllocator>(cPageSize);
+	}
+	return *tree.m_allocator;
+}
+
+bool MCTS_TreeCache::isComplete() const
+{
+	return std::all_of(m_trees.begin(), m_trees.end(), [](const Tree& tree) { return tree.m_pRoot && (tree.m_pRoot->isProven() || isFull(*tree.m_allocator)); });
+}
+
+MTCS_Node* MCTS_TreeCache::findNode(MTCS_Node* pNode, u64 hash, u32 depth)
+{
+	if (pNode->m_gameState.m_gameState.getHash() == hash) {
+		return pNode;
+	}
+	if (depth == cMaxSearchDepth) {
+		return nullptr;
+	}
+	for (u32 i = 0; i < pNode->m_numChildren; ++i) {
+		if (pNode->m_children[i]) {
+			if (MTCS_Node* pFound = findNode(pNode->m_children[i], hash, depth + 1)) {
+				return pFound;
+			}
+		}
+	}
+	return nullptr;
+}
+
+bool MCTS_TreeCache::setRootChildren(MTCS_Node* pRoot, const sevenWD::Move moves[], u32 numMoves, core::LinearAllocator& linAllocator)
+{
+	// MCTS_Zero keeps one slot per move (nullptr until selected), MCTS_Deterministic keeps its unexplored moves apart
+	if (pRoot->m_numChildren + pRoot->m_numUnexploredMoves != numMoves) {
+		return false;
+	}
+
+	MTCS_Node* children[sevenWD::GameController::cMaxMoveListSize] = { nullptr };
+	for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
+		MTCS_Node* pChild = pRoot->m_children[j];
+		if (pChild == nullptr) {
+			continue;
+		}
+		const sevenWD::Move* pMove = std::find(moves, moves + numMoves, pChild->m_move_from_parent);
+		if (pMove == moves + numMoves) {
+			return false;
+		}
+		children[pMove - moves] = pChild;
+	}
+
+	// the caller expects one child per move, in the order of moves
+	for (u32 i = 0; i < numMoves; ++i) {
+		if (children[i] == nullptr) {
+			sevenWD::GameController newGameState = pRoot->m_gameState;
+			newGameState.play(moves[i]);
+			children[i] = linAllocator.allocate<MTCS_Node>(pRoot, moves[i], newGameState);
+		}
+		pRoot->m_pMoves[i] = moves[i];
+		pRoot->m_children[i] = children[i];
+	}
+	pRoot->m_numChildren = (u8)numMoves;
+	pRoot->m_numUnexploredMoves = 0;
+	return true;
+}
+
+MTCS_Node* MCTS_TreeCache::takeRoot(u32 i, const sevenWD::GameController& _game, const sevenWD::Move moves[], u32 numMoves)
+{
+	Tree& tree = m_trees[i];
+
+	MTCS_Node* pRoot = nullptr;
+	if (tree.m_pRoot && tree.m_allocator->getUsedSize() <= cMaxTreeSize) {
+		pRoot = findNode(tree.m_pRoot, _game.m_gameState.getHash(), 0);
+	}
+	if (pRoot == nullptr) {
+		dropTree(tree);
+		return nullptr;
+	}
+
+	// the released nodes stay in the allocator until the tree is dropped
+	tree.m_pRoot->cleanupExcept(pRoot);
+	tree.m_pRoot = pRoot;
+	pRoot->m_pParent = nullptr;
+	pRoot->m_move_from_parent = sevenWD::Move{};
+
+	// a node never expanded is initialized by the caller like a new root
+	const bool isExpanded = pRoot->m_numChildren > 0 || pRoot->m_numUnexploredMoves > 0;
+	if (isExpanded && !setRootChildren(pRoot, moves, numMoves, *tree.m_allocator)) {
+		dropTree(tree);
+		return nullptr;
+	}
+
+	// owned by the caller until keepRoot()
+	tree.m_pRoot = nullptr;
+	return pRoot;
+}
+
+MCTS_ThreadContext::~MCTS_ThreadContext()
+{
+	m_stopSearch = true;
+	m_ponderTask.wait();
+}
+
+// nullptr when the AI was not reusing its trees when the context was created
+static MCTS_ThreadContext* getMCTSThreadContext(void* pThreadContext)
+{
+	return pThreadContext ? dynamic_cast<MCTS_ThreadContext*>((BaseNetworkAI::ThreadContext*)pThreadContext) : nullptr;
+}
+
+// Tree cache of the thread context, nullptr when the trees are not reused
+static MCTS_TreeCache* getTreeCache(bool reuseTree, void* pThreadContext)
+{
+	MCTS_ThreadContext* pContext = reuseTree ? getMCTSThreadContext(pThreadContext) : nullptr;
+	return pContext ? &pContext->m_treeCache : nullptr;
+}
+
+// --------------------------------------------------- //
+// -------------------- MCTS_Arena ------------------- //
+// --------------------------------------------------- //
+namespace
+{
+	struct ThreadArenas {
+		core::LinearAllocator m_arena{ MCTS_Arena::cPageSize, true };
+		std::vector<std::unique_ptr<core::LinearAllocator>> m_sharedArenas;
+		bool m_isAcquired = false;
+		bool m_isSharedAcquired = false;
+	};
+
+	thread_local ThreadArenas t_arenas;
+	std::atomic<size_t> s_arenaHighWaterMark = 0;
+}
+
+core::LinearAllocator& MCTS_Arena::acquire()
+{
+	DEBUG_ASSERT(!t_arenas.m_isAcquired);
+	t_arenas.m_isAcquired = true;
+	return t_arenas.m_arena;
+}
+
+std::vector<std::unique_ptr<core::LinearAllocator>>& MCTS_Arena::acquireShared(u32 numArenas)
+{
+	DEBUG_ASSERT(!t_arenas.m_isSharedAcquired);
+	t_arenas.m_isSharedAcquired = true;
+	std::vector<std::unique_ptr<core::LinearAllocator>>& arenas = t_arenas.m_sharedArenas;
+	arenas.resize(numArenas);
+	for (auto& pArena : arenas) {
+		if (!pArena) {
+			pArena = std::make_unique<core::LinearAllocator>(cPageSize, true);
+		}
+	}
+	return arenas;
+}
+
+static void releaseArena(core::LinearAllocator& arena)
+{
+	size_t highWaterMark = s_arenaHighWaterMark.load(std::memory_order_relaxed);
+	while (arena.getHighWaterMark() > highWaterMark
+		&& !s_arenaHighWaterMark.compare_exchange_weak(highWaterMark, arena.getHighWaterMark(), std::memory_order_relaxed)) {}
+	arena.resetHighWaterMark();
+
+	if (arena.getReservedSize() > MCTS_Arena::cMaxKeptSize) {
+		arena.release();
+	}
+	else {
+		arena.reset();
+	}
+}
+
+void MCTS_Arena::release(core::LinearAllocator& arena)
+{
+	DEBUG_ASSERT(t_arenas.m_isAcquired && &arena == &t_arenas.m_arena);
+	releaseArena(arena);
+	t_arenas.m_isAcquired = false;
+}
+
+void MCTS_Arena::release(std::vector<std::unique_ptr<core::LinearAllocator>>& arenas)
+{
+	DEBUG_ASSERT(t_arenas.m_isSharedAcquired && &arenas == &t_arenas.m_sharedArenas);
+	for (auto& pArena : arenas) {
+		releaseArena(*pArena);
+	}
+	t_arenas.m_isSharedAcquired = false;
+}
+
+size_t MCTS_Arena::getHighWaterMark()
+{
+	return s_arenaHighWaterMark.load(std::memory_order_relaxed);
+}
+
+void MCTS_Arena::resetStats()
+{
+	s_arenaHighWaterMark.store(0, std::memory_order_relaxed);
+}
+
+// MCTS-Solver: a position is won by the player to move when one of its moves wins and lost when all of them lose.
+// Called once pNode is proven, the proof climbs the path while its nodes get proven as well.
+static void propagateProven(const MTCS_Node* pNode)
+{
+	for (MTCS_Node* pParent = pNode->m_pParent; pParent != nullptr && !pParent->isProven(); pParent = pParent->m_pParent) {
+		const u8 mover = pParent->m_playerTurn;
+		bool isWon = false;
+		// children still to create (unexplored moves, lazy children) are not proven
+		bool isLost = pParent->m_numChildren > 0 && pParent->m_numUnexploredMoves == 0;
+		for (u32 i = 0; i < pParent->m_numChildren && !isWon; ++i) {
+			const MTCS_Node* pChild = pParent->m_children[i];
+			const u8 winner = pChild ? pChild->getProvenWinner() : MTCS_Node::cUnproven;
+			isWon = winner == mover;
+			isLost &= winner == 1 - mover;
+		}
+
+		if (isWon) {
+			pParent->setProvenWinner(mover);
+		}
+		else if (isLost) {
+			pParent->setProvenWinner(u8(1 - mover));
+		}
+		else {
+			break;
+		}
+	}
+}
+
+// Index of a root child proven to win for the player to move, u32(-1) if none
+static u32 findProvenWin(const MTCS_Node* pRoot)
+{
+	for (u32 i = 0; i < pRoot->m_numChildren; ++i) {
+		const MTCS_Node* pChild = pRoot->m_children[i];
+		if (pChild && pChild->getProvenWinner() == pRoot->m_playerTurn) {
+			return i;
+		}
+	}
+	return u32(-1);
+}
+
+// --------------------------------------------------- //
+// -------------- MCTS_TranspositionTable ------------ //
+// --------------------------------------------------- //
+MCTS_TranspositionTable::MCTS_TranspositionTable(size_t memoryBudget)
+{
+	// allocated once, the table then never rehashes
+	m_maxNumNodes = (size_t)(memoryBudget * m_nodes.max_load_factor() / cSlotSize);
+	m_nodes.reserve(m_maxNumNodes);
+}
+
+MTCS_Node* MCTS_TranspositionTable::find(u64 hash, u32 owner) const
+{
+	auto it = m_nodes.find(makeKey(hash, owner));
+	return it != m_nodes.end() ? it->second : nullptr;
+}
+
+void MCTS_TranspositionTable::insert(u64 hash, u32 owner, MTCS_Node* pNode)
+{
+	if (m_nodes.size() < m_maxNumNodes) {
+		m_nodes.emplace(makeKey(hash, owner), pNode);
 	}
 }
 
+// --------------------------------------------------- //
+// ---------------- MCTS_Deterministic --------------- //
+// --------------------------------------------------- //
+MCTS_Deterministic::MCTS_Deterministic(u32 numMoves, u32 numGameState, bool mt) : BaseNetworkAI("MCTS_Deterministic", {}), m_useMT(mt), m_numMoves(numMoves), m_numSampling(numGameState)
+{
+}
+
 std::pair<sevenWD::Move, float> MCTS_Deterministic::selectMove(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext)
 {
 	using namespace sevenWD;
@@ -65,17 +356,40 @@ std::pair<sevenWD::Move, float> MCTS_Deterministic::selectMove(const sevenWD::Ga
 	std::vector<float> scores(_moves.size(), 0);
 	std::mutex* pMutex = nullptr;
 
+	MCTS_TreeCache* pTreeCache = getTreeCache(m_reuseTree, pThreadContext);
+	if (pTreeCache) {
+		pTreeCache->resize(m_numSampling);
+	}
+
+	const core::Deadline deadline(m_timeBudgetMs);
+	// one random stream per sampling, taken from the stream of the game
+	const u64 searchStream = _sevenWDContext.rand()();
+
 	auto processRange = [&](u32 start, u32 end)
 	{
-		core::LinearAllocator linAllocator(8 * 1024 * 1024);
-		std::vector<Move> scratchMoves;
+		core::LinearAllocator& arena = MCTS_Arena::acquire();
+		GameController::MoveList scratchMoves;
 
 		for (u32 i = start; i < end; ++i) {
+			const ScopedRandStream samplingStream(_sevenWDContext, searchStream + i);
 			u32 maxDepth = 0;
-			MTCS_Node* pRoot = linAllocator.allocate<MTCS_Node>((MTCS_Node*)nullptr, Move{}, _game);
-			pRoot->m_gameState.m_gameState.makeDeterministic();
-			initRoot(pRoot, _moves.data(), (u32)_moves.size(), linAllocator);
-			for (unsigned int iter = 0; iter < m_numMoves; ++iter) {
+			const core::Deadline samplingDeadline = deadline.getSlice(i - start, end - start);
+			core::LinearAllocator& linAllocator = pTreeCache ? pTreeCache->getAllocator(i) : arena;
+			MTCS_Node* pRoot = pTreeCache ? pTreeCache->takeRoot(i, _game, _moves.data(), (u32)_moves.size()) : nullptr;
+			if (pRoot == nullptr) {
+				pRoot = linAllocator.allocate<MTCS_Node>((MTCS_Node*)nullptr, Move{}, _game);
+				// the future ages of the determinization live in the allocator of its nodes
+				pRoot->m_gameState.m_gameState.makeDeterministic(*linAllocator.allocate<GameState::DeterminizedSetup>());
+			}
+			if (pRoot->m_numChildren == 0) {
+				initRoot(pRoot, _moves.data(), (u32)_moves.size(), linAllocator);
+			}
+
+			// a reused root already holds the visits of the previous search
+			const u32 numIterations = m_numMoves - std::min(m_numMoves, pRoot->m_visits.load());
+			// the first iteration runs even past the deadline so this sampling has a visited child to vote for, the next
+			// ones only while the root is unsolved and the slice of the time budget lasts
+			for (unsigned int iter = 0; iter < numIterations && (iter == 0 || (!pRoot->isProven() && !samplingDeadline.hasExpired())); ++iter) {
 				u32 depth = 0;
 				MTCS_Node* pSelectedNode = selection(pRoot, depth);
 				MTCS_Node* pExpandedNode = expansion(pSelectedNode, linAllocator);
@@ -92,22 +406,38 @@ std::pair<sevenWD::Move, float> MCTS_Deterministic::selectMove(const sevenWD::Ga
 
 			DEBUG_ASSERT(pRoot->m_numChildren == sampledVisits.size());
 			maxDepthAvg += (float)maxDepth;
-			for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
-				sampledVisits[j] += pRoot->m_children[j]->m_visits;
-				scores[j] += pRoot->m_children[j]->m_totalRewards;
+			const u32 provenWinIndex = findProvenWin(pRoot);
+			if (provenWinIndex != u32(-1)) {
+				// solved determinization, the winning move gets a whole budget of winning visits
+				sampledVisits[provenWinIndex] += m_numMoves;
+				scores[provenWinIndex] += (float)m_numMoves;
+			}
+			else {
+				for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
+					sampledVisits[j] += pRoot->m_children[j].load()->m_visits;
+					scores[j] += pRoot->m_children[j].load()->m_totalRewards;
+				}
 			}
 
 			if (pMutex) pMutex->unlock();
 
-			pRoot->cleanup();
-			linAllocator.reset();
+			if (pTreeCache) {
+				pTreeCache->keepRoot(i, pRoot);
+			}
+			else {
+				pRoot->cleanup();
+				linAllocator.reset();
+			}
 		}
+
+		MCTS_Arena::release(arena);
 	};
 
-	if (m_threadPool) {
+	if (m_useMT) {
 		std::mutex mut;
 		pMutex = &mut;
-		m_threadPool->parallelize_loop(0u, m_numSampling, processRange, m_numSampling);
+		// with a time budget, one block per thread so its samplings share the budget instead of waiting in the queue
+		core::parallelFor(0u, m_numSampling, processRange, deadline.isSet() ? core::Scheduler::get().getNumWorkers() : m_numSampling);
 	}
 	else {
 		processRange(0u, m_numSampling);
@@ -135,10 +465,7 @@ void  MCTS_Deterministic::initRoot(MTCS_Node* pNode, const sevenWD::Move moves[]
 	DEBUG_ASSERT(pNode->m_numUnexploredMoves == 0);
 
 	pNode->m_numUnexploredMoves = 0;
-	
-	if (numMoves > pNode->m_childrenStorage.size()) {
-		pNode->m_children = new MTCS_Node*[numMoves];
-	}
+	pNode->reserveChildren(numMoves, linAllocator);
 
 	for (u32 i = 0; i < numMoves; ++i) {
 		sevenWD::GameController newGameState = pNode->m_gameState;
@@ -151,24 +478,24 @@ void  MCTS_Deterministic::initRoot(MTCS_Node* pNode, const sevenWD::Move moves[]
 MTCS_Node* MCTS_Deterministic::selection(MTCS_Node* pNode, u32& depth)
 {
 	depth++;
-	if (pNode->m_numChildren == 0 || pNode->m_numUnexploredMoves > 0) {
+	if (pNode->m_numChildren == 0 || pNode->m_numUnexploredMoves > 0 || pNode->isProven()) {
 		return pNode;
 	}
 	else {
 		float bestUCB = -1.0f;
 		MTCS_Node* pBestChild = nullptr;
+		MTCS_Node* pLostChild = nullptr;
 		for (u32 i = 0; i < pNode->m_numChildren; ++i) {
 			MTCS_Node* pChild = pNode->m_children[i];
 
-			// Special-case: if any child is an immediate winning move for the player who played it, take it.
-			sevenWD::GameController::State st = pChild->m_gameState.m_gameState.m_state;
-			if (st == sevenWD::GameState::State::WinPlayer0 || st == sevenWD::GameState::State::WinPlayer1) {
-				u32 winner = (st == sevenWD::GameState::State::WinPlayer0) ? 0u : 1u;
+			// Special-case: if any child is a proven win for the player who played it, take it. Skip the proven losses.
+			if (pChild->isProven()) {
 				// owner is the player who made the move that produced this child
-				u32 owner = pNode->m_playerTurn;
-				if (owner == winner) {
-					return pChild; // immediate forced win
+				if (pChild->getProvenWinner() == pNode->m_playerTurn) {
+					return pChild; // forced win
 				}
+				pLostChild = pChild;
+				continue;
 			}
 
 			float ucb = (pChild->m_totalRewards / (pChild->m_visits + cEpsilon)) +  
@@ -179,13 +506,14 @@ MTCS_Node* MCTS_Deterministic::selection(MTCS_Node* pNode, u32& depth)
 				pBestChild = pChild;
 			}
 		}
-		return selection(pBestChild, depth);
+		// only lost moves left, the root of a lost position is proven by visiting one of them
+		return selection(pBestChild ? pBestChild : pLostChild, depth);
 	}
 }
 
 MTCS_Node* MCTS_Deterministic::expansion(MTCS_Node* pNode, core::LinearAllocator& linAllocator)
 {
-	if (pNode->m_gameState.m_winType != sevenWD::WinType::None) {
+	if (pNode->isProven()) {
 		return pNode;
 	}
 	else {
@@ -193,18 +521,17 @@ MTCS_Node* MCTS_Deterministic::expansion(MTCS_Node* pNode, core::LinearAllocator
 			DEBUG_ASSERT(pNode->m_numChildren == 0);
 
 			// initialize unexplored moves
-			pNode->m_numUnexploredMoves = (u16)pNode->m_gameState.enumerateMoves(pNode->m_pMoves, (u32)pNode->m_moveStorage.size());
-			DEBUG_ASSERT(pNode->m_numUnexploredMoves > 0);
+			sevenWD::GameController::MoveList moves;
+			pNode->m_gameState.enumerateMoves(moves);
+			DEBUG_ASSERT(!moves.empty());
 
-			if (pNode->m_numUnexploredMoves > pNode->m_moveStorage.size()) {
-				pNode->m_pMoves = new sevenWD::Move[pNode->m_numUnexploredMoves];
-				pNode->m_children = new MTCS_Node*[pNode->m_numUnexploredMoves];
-				pNode->m_gameState.enumerateMoves(pNode->m_pMoves, pNode->m_numUnexploredMoves);
-			}
+			pNode->reserveChildren(moves.size(), linAllocator);
+			std::copy(moves.begin(), moves.end(), pNode->m_pMoves);
+			pNode->m_numUnexploredMoves = (u16)moves.size();
 		}
 
 		// expand
-		u32 moveIndex = m_rand() % pNode->m_numUnexploredMoves;
+		u32 moveIndex = pNode->m_gameState.m_gameState.m_context->rand()() % pNode->m_numUnexploredMoves;
 		sevenWD::Move move = pNode->m_pMoves[moveIndex];
 		// remove move from unexplored moves
 		pNode->m_pMoves[moveIndex] = pNode->m_pMoves[pNode->m_numUnexploredMoves - 1];
@@ -218,17 +545,15 @@ MTCS_Node* MCTS_Deterministic::expansion(MTCS_Node* pNode, core::LinearAllocator
 	}
 }
 
-std::pair<float, u32> MCTS_Deterministic::playout(MTCS_Node* pNode, std::vector<sevenWD::Move>& scratchMoves, void* pThreadContext)
+std::pair<float, u32> MCTS_Deterministic::playout(MTCS_Node* pNode, sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext)
 {
 	using namespace sevenWD;
 
 	const u32 rootPlayer = pNode->m_playerTurn;
 
-	if (pNode->m_gameState.m_winType != WinType::None) {
-		GameController::State state = pNode->m_gameState.m_gameState.m_state;
-		float reward = (state == GameState::State::WinPlayer0) ? (rootPlayer == 0 ? 1.0f : 0.0f) : 
-			           (state == GameState::State::WinPlayer1 ? (rootPlayer == 1 ? 1.0f : 0.0f) : 0.0f);
-		return { reward, rootPlayer };
+	// finished game or solved subtree, the value is exact
+	if (pNode->isProven()) {
+		return { pNode->getProvenWinner() == rootPlayer ? 1.0f : 0.0f, rootPlayer };
 	}
 
 	if (m_heuristic == Heuristic_UseDNN) {
@@ -236,6 +561,7 @@ std::pair<float, u32> MCTS_Deterministic::playout(MTCS_Node* pNode, std::vector<
 	}
 
 	GameController controller = pNode->m_gameState;
+	core::RandomStream& rng = controller.m_gameState.m_context->rand();
 	bool end = false;
 	scratchMoves.clear();
 	while (!end) {
@@ -254,7 +580,7 @@ std::pair<float, u32> MCTS_Deterministic::playout(MTCS_Node* pNode, std::vector<
 				}
 			}
 			if (numNonBurnMoves > 0) {
-				u32 index = m_rand() % numNonBurnMoves;
+				u32 index = rng() % numNonBurnMoves;
 				for (u32 i = 0; i < scratchMoves.size(); ++i) {
 					if (scratchMoves[i].action != Move::Action::Burn) {
 						if (index == 0) {
@@ -270,7 +596,7 @@ std::pair<float, u32> MCTS_Deterministic::playout(MTCS_Node* pNode, std::vector<
 		}
 
 		if (!hasMoved) {
-			Move move = scratchMoves[m_rand() % scratchMoves.size()];
+			Move move = scratchMoves[rng() % scratchMoves.size()];
 			end = controller.play(move);
 		}
 	}
@@ -294,19 +620,23 @@ void MCTS_Deterministic::backPropagate(MTCS_Node* pNode, float reward)
 {
 	DEBUG_ASSERT(pNode);
 
+	if (pNode->isProven()) {
+		propagateProven(pNode);
+	}
+
 	const u32 playoutPlayer = pNode->m_playerTurn;
 
 	MTCS_Node* pCur = pNode;
 	while (pCur != nullptr) {
 		// increment visit count for this node
-		pCur->m_visits++;
+		pCur->addVisit();
 
 		// If node has a parent, the parent.currentPlayer is the player who played the move that produced 'pCur'.
 		// Use that owner to decide reward sign: if owner == playoutPlayer use reward, else invert.
 		if (pCur->m_pParent) {
 			const u32 owner = pCur->m_pParent->m_playerTurn;
 			const float valueForOwner = (owner == playoutPlayer) ? reward : (1.0f - reward);
-			pCur->m_totalRewards += valueForOwner;
+			pCur->addReward(valueForOwner);
 		}
 
 		pCur = pCur->m_pParent;
@@ -326,15 +656,22 @@ MCTS_Zero::MCTS_Zero(u32 numMoves, u32 numGameState, bool mt) : BaseNetworkAI("M
 
 void MCTS_Zero::enableMT()
 {
-	if (m_threadPool == nullptr) {
-		m_threadPool = new thread_pool(std::thread::hardware_concurrency());
-	}
+	m_useMT = true;
+}
+
+void MCTS_Zero::enableNNCache(u32 sizeMB)
+{
+	m_nnCache = std::make_shared<NNEvalCache>(size_t(sizeMB) * 1024 * 1024);
 }
 
 std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext)
 {
 	using namespace sevenWD;
 
+	if (m_useISMCTS) {
+		return selectMoveISMCTS(_game, _moves, pThreadContext);
+	}
+
 	float maxDepthAvg = 0;
 	std::vector<u32> sampledVisits(_moves.size(), 0);
 	std::vector<float> scores(_moves.size(), 0);
@@ -342,26 +679,94 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 	u32 puctPriorsWeight[GameController::cMaxNumMoves] = { 0 };
 	std::mutex* pMutex = nullptr;
 
+	const bool treeParallel = useTreeParallel();
+	const bool gumbel = useGumbel();
+	const bool useBatch = m_useNNHeuristic && m_nnBatchSize > 1 && !treeParallel && !gumbel;
+	const u32 batchSize = std::min(m_nnBatchSize, cMaxNNBatchSize);
+
+	MCTS_TreeCache* pTreeCache = getTreeCache(m_reuseTree && !treeParallel, pThreadContext);
+	if (pTreeCache) {
+		pTreeCache->resize(m_numSampling);
+	}
+
+	// a reused tree keeps its nodes after the search, the tree cache expects a tree
+	const bool useTranspositions = m_transpositionBudgetMB > 0 && !treeParallel && !useBatch && pTreeCache == nullptr;
+
+	// one arena per thread sharing a tree
+	std::vector<std::unique_ptr<core::LinearAllocator>>* pTreeArenas = treeParallel ? &MCTS_Arena::acquireShared(m_numTreeThreads) : nullptr;
+
+	// a pondering search has no time budget, it ends when its context is told to stop
+	MCTS_ThreadContext* pMCTSContext = getMCTSThreadContext(pThreadContext);
+	const bool pondering = pMCTSContext && pMCTSContext->m_isPondering;
+	const core::Deadline deadline = core::Deadline(pondering ? 0 : m_timeBudgetMs).withStopFlag(pMCTSContext ? &pMCTSContext->m_stopSearch : nullptr);
+	// one random stream per sampling, taken from the stream of the game
+	const u64 searchStream = _sevenWDContext.rand()();
+
 	auto processRange = [&](u32 start, u32 end)
 	{
-			core::LinearAllocator linAllocator(8 * 1024 * 1024);
-			std::vector<Move> scratchMoves;
+			core::LinearAllocator& arena = MCTS_Arena::acquire();
+			GameController::MoveList scratchMoves;
+			LeafBatch batch(useBatch ? batchSize : 0);
+			std::unique_ptr<MCTS_TranspositionTable> pTranspositions;
+			if (useTranspositions) {
+				pTranspositions = std::make_unique<MCTS_TranspositionTable>(size_t(m_transpositionBudgetMB) * 1024 * 1024);
+			}
 
 			for (u32 i = start; i < end; ++i) {
+				const ScopedRandStream samplingStream(_sevenWDContext, searchStream + i);
 				u32 maxDepth = 0;
-				MTCS_Node* pRoot = linAllocator.allocate<MTCS_Node>((MTCS_Node*)nullptr, Move{}, _game);
-				pRoot->m_gameState.m_gameState.makeDeterministic();
-				initRoot(pRoot, _moves.data(), (u32)_moves.size(), linAllocator, pThreadContext);
-				for (unsigned int iter = 0; iter < m_numMoves; ++iter) {
-					u32 depth = 0;
-					MTCS_Node* pSelectedNode = selection(pRoot, depth, linAllocator, pThreadContext);
-					auto [reward, simPlayer] = playout(pSelectedNode, scratchMoves, pThreadContext);
-					DEBUG_ASSERT(simPlayer == pSelectedNode->m_playerTurn);
-					if (pSelectedNode->m_gameState.m_winType != WinType::None) {
-						DEBUG_ASSERT(simPlayer == pSelectedNode->m_pParent->m_playerTurn);
+				u32 gumbelSelected = 0;
+				const core::Deadline samplingDeadline = deadline.getSlice(i - start, end - start);
+				core::LinearAllocator& linAllocator = pTreeCache ? pTreeCache->getAllocator(i) : arena;
+				const MTCS_Node* pPreviousRoot = pTreeCache ? pTreeCache->m_trees[i].m_pRoot : nullptr;
+				MTCS_Node* pRoot = pTreeCache ? pTreeCache->takeRoot(i, _game, _moves.data(), (u32)_moves.size()) : nullptr;
+				if (pRoot == nullptr) {
+					pRoot = linAllocator.allocate<MTCS_Node>((MTCS_Node*)nullptr, Move{}, _game);
+					// the future ages of the determinization live in the allocator of its nodes
+					pRoot->m_gameState.m_gameState.makeDeterministic(*linAllocator.allocate<GameState::DeterminizedSetup>());
+				}
+				if (pRoot->m_numChildren == 0) {
+					initRoot(pRoot, _moves.data(), (u32)_moves.size(), linAllocator, pThreadContext);
+				}
+				else if (!gumbel && pRoot != pPreviousRoot) {
+					// reused subtree, its priors come from the previous search
+					// (a root searched again without a move played, by a pondering round or a restart, keeps its noise)
+					addDirichletNoise(pRoot, _moves.data(), (u32)_moves.size());
+				}
+
+				// a pondering round stops growing a tree once it is solved or before it is too big to be reused
+				auto canGrow = [&]() { return !pondering || (!pRoot->isProven() && !MCTS_TreeCache::isFull(linAllocator)); };
+				// a reused root already holds the visits of the previous search, a pondering round adds to them
+				const u32 numIterations = pondering ? (canGrow() ? m_numMoves : 0) : m_numMoves - std::min(m_numMoves, pRoot->m_visits.load());
+				if (treeParallel) {
+					// the threads share this root and its iteration budget
+					maxDepth = searchTreeParallel(pRoot, numIterations, samplingDeadline, *pTreeArenas, pThreadContext);
+				}
+				else if (useBatch) {
+					// counted in leaves: a whole first batch runs even past the deadline, the next batches stop on the same
+					// conditions as the single leaf loop below and never go over the iteration budget
+					for (u32 iter = 0; iter < numIterations && (iter == 0 || (!pRoot->isProven() && !samplingDeadline.hasExpired() && canGrow())); ) {
+						iter += simulateBatch(pRoot, std::min(batchSize, numIterations - iter), maxDepth, linAllocator, batch, scratchMoves, pThreadContext);
+					}
+				}
+				else if (gumbel && !pondering) {
+					// the sequential halving needs a budget, a pondering round grows the Gumbel root like any other
+					gumbelSelected = searchGumbel(pRoot, numIterations, samplingDeadline, maxDepth, linAllocator, scratchMoves, pTranspositions.get(), pThreadContext);
+				}
+				else {
+					// the first iteration runs even past the deadline so this sampling has visits to vote with, the next ones
+					// only while the root is unsolved, the slice of the time budget lasts and a pondered tree can grow
+					for (unsigned int iter = 0; iter < numIterations && (iter == 0 || (!pRoot->isProven() && !samplingDeadline.hasExpired() && canGrow())); ++iter) {
+						u32 depth = 0;
+						MTCS_Node* pSelectedNode = selection(pRoot, depth, linAllocator, pThreadContext, nullptr, pTranspositions.get());
+						auto [reward, simPlayer] = playout(pSelectedNode, scratchMoves, pThreadContext);
+						DEBUG_ASSERT(simPlayer == pSelectedNode->m_playerTurn);
+						if (pSelectedNode->m_gameState.m_winType != WinType::None) {
+							DEBUG_ASSERT(simPlayer == pSelectedNode->m_pParent->m_playerTurn);
+						}
+						backPropagate(pSelectedNode, reward);
+						maxDepth = std::max(depth, maxDepth);
 					}
-					backPropagate(pSelectedNode, reward);
-					maxDepth = std::max(depth, maxDepth);
 				}
 
 				if (pMutex) pMutex->lock();
@@ -376,7 +781,31 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 				// In case of many samplings, we can use the best move in avg regarding all sampled states, 
 				// Else we use sum of visits to avoid too much noise in the gameState randomness. This supposely helps in case of low sampling count used during training.
 				// In case of strong play, m_numSampling should be large and the best move is chosen regardless if it is a "very good move" or just a "good move". (especially against humans that will do some mistake anyway).
-				if (m_useBestAvgSampledScenario) {
+				const u32 provenWinIndex = findProvenWin(pRoot);
+				if (provenWinIndex != u32(-1)) {
+					// solved determinization, the winning move gets the whole sampling
+					for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
+						u32 moveFixedIndex = pRoot->m_pMoves[j].computeMoveFixedIndex(*pContext);
+						puctPriors[moveFixedIndex] += (j == provenWinIndex) ? 1.0f : 0.0f;
+						puctPriorsWeight[moveFixedIndex]++;
+					}
+					sampledVisits[provenWinIndex] += (m_useBestAvgSampledScenario || gumbel) ? 1 : m_numMoves;
+					scores[provenWinIndex] += (m_useBestAvgSampledScenario || gumbel) ? 1.0f : (float)m_numMoves;
+				}
+				else if (gumbel) {
+					// the move left by the sequential halving gets the vote, the improved policy is the PUCT target
+					float completedQ[GameController::cMaxMoveListSize];
+					float policy[GameController::cMaxMoveListSize];
+					computeGumbelPolicy(pRoot, completedQ, policy);
+					for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
+						u32 moveFixedIndex = pRoot->m_pMoves[j].computeMoveFixedIndex(*pContext);
+						puctPriors[moveFixedIndex] += policy[j];
+						puctPriorsWeight[moveFixedIndex]++;
+						scores[j] += completedQ[j];
+					}
+					sampledVisits[gumbelSelected] += 1;
+				}
+				else if (m_useBestAvgSampledScenario) {
 					// find best child in this sampled scenario
 					u32 bestIndex = 0;
 					u32 bestVisits = 0;
@@ -385,7 +814,7 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 						u32 moveFixedIndex = pChild->m_move_from_parent.computeMoveFixedIndex(*pContext);
 						puctPriors[moveFixedIndex] += (float)pChild->m_visits / pRoot->m_visits;
 						puctPriorsWeight[moveFixedIndex]++;
-						if (pRoot->m_children[bestIndex]->m_visits > 0) {
+						if (pChild->m_visits > 0) {
 							scores[j] += pChild->m_totalRewards / pChild->m_visits;
 						}
 
@@ -400,31 +829,55 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 				else {
 					// accumulate all children stats
 					for (u32 j = 0; j < pRoot->m_numChildren; ++j) {
-						sampledVisits[j] += pRoot->m_children[j]->m_visits;
-						scores[j] += pRoot->m_children[j]->m_totalRewards;
+						sampledVisits[j] += pRoot->m_children[j].load()->m_visits;
+						scores[j] += pRoot->m_children[j].load()->m_totalRewards;
 
-						u32 moveFixedIndex = pRoot->m_children[j]->m_move_from_parent.computeMoveFixedIndex(*pContext);
-						puctPriors[moveFixedIndex] += (float)pRoot->m_children[j]->m_visits / pRoot->m_visits;
+						u32 moveFixedIndex = pRoot->m_children[j].load()->m_move_from_parent.computeMoveFixedIndex(*pContext);
+						puctPriors[moveFixedIndex] += (float)pRoot->m_children[j].load()->m_visits / pRoot->m_visits;
 						puctPriorsWeight[moveFixedIndex]++;
 					}
 				}
 
 				if (pMutex) pMutex->unlock();
 
-				pRoot->cleanup();
-				linAllocator.reset();
+				if (pTreeCache) {
+					pTreeCache->keepRoot(i, pRoot);
+				}
+				else {
+					pRoot->cleanup();
+					linAllocator.reset();
+					if (pTranspositions) {
+						pTranspositions->clear();
+					}
+					if (pTreeArenas) {
+						for (auto& pTreeArena : *pTreeArenas) {
+							pTreeArena->reset();
+						}
+					}
+				}
 			}
+
+			if (m_nnCache) {
+				m_nnCache->flushStats();
+			}
+			MCTS_Arena::release(arena);
 		};
 
-	if (m_threadPool) {
+	if (m_useMT && !treeParallel) {
 		std::mutex mut;
 		pMutex = &mut;
-		m_threadPool->parallelize_loop(0u, m_numSampling, processRange, m_numSampling);
+		// with a time budget, one block per thread so its samplings share the budget instead of waiting in the queue
+		core::parallelFor(0u, m_numSampling, processRange, deadline.isSet() ? core::Scheduler::get().getNumWorkers() : m_numSampling);
 	}
 	else {
+		// the tree-parallel search uses the scheduler inside each sampling
 		processRange(0u, m_numSampling);
 	}
 
+	if (pTreeArenas) {
+		MCTS_Arena::release(*pTreeArenas);
+	}
+
 	maxDepthAvg = maxDepthAvg / m_numSampling;
 
 	// Get context from game state
@@ -434,8 +887,9 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 	u32 bestIndex = 0;
 	u32 bestVisits = 0;
 	for (u32 i = 0; i < sampledVisits.size(); ++i) {
-		scores[i] /= (m_useBestAvgSampledScenario ? m_numSampling : sampledVisits[i]);
-		if (sampledVisits[i] > bestVisits) {
+		scores[i] /= ((m_useBestAvgSampledScenario || gumbel) ? m_numSampling : sampledVisits[i]);
+		// the Gumbel votes are few, a tie goes to the best average value
+		if (sampledVisits[i] > bestVisits || (gumbel && sampledVisits[i] == bestVisits && scores[i] > scores[bestIndex])) {
 			bestVisits = sampledVisits[i];
 			bestIndex = i;
 		}
@@ -455,48 +909,124 @@ std::pair<sevenWD::Move, float> MCTS_Zero::selectMove(const sevenWD::GameContext
 	return { _moves[bestIndex], scores[bestIndex] };
 }
 
+bool MCTS_Zero::startPondering(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, void* pThreadContext)
+{
+	stopPondering(pThreadContext);
+
+	// the search is only worth something if its trees are kept for the next one
+	MCTS_ThreadContext* pContext = getMCTSThreadContext(pThreadContext);
+	if (pContext == nullptr || getTreeCache(m_reuseTree && !useTreeParallel() && !m_useISMCTS, pThreadContext) == nullptr) {
+		return false;
+	}
+
+	std::vector<sevenWD::Move> moves;
+	if (_game.m_winType == sevenWD::WinType::None) {
+		_game.enumerateMoves(moves);
+	}
+	if (moves.empty()) {
+		return false;
+	}
+
+	// the calling thread keeps its game, the search works on a copy and its results are dropped
+	pContext->m_isPondering = true;
+	pContext->m_ponderTask.run([this, &_sevenWDContext, game = _game, moves = std::move(moves), pThreadContext, pContext]()
+		{
+			// rounds until stopped or until no tree can grow
+			while (!pContext->m_stopSearch) {
+				selectMove(_sevenWDContext, game, moves, pThreadContext);
+				if (pContext->m_treeCache.isComplete()) {
+					break;
+				}
+			}
+		});
+	return true;
+}
+
+void MCTS_Zero::stopPondering(void* pThreadContext)
+{
+	MCTS_ThreadContext* pContext = getMCTSThreadContext(pThreadContext);
+	if (pContext && pContext->m_isPondering) {
+		pContext->m_stopSearch = true;
+		pContext->m_ponderTask.wait();
+		pContext->m_stopSearch = false;
+		pContext->m_isPondering = false;
+	}
+}
+
 void MCTS_Zero::computeNNInference(MTCS_Node* pNode, void* pContext) const
 {
-	const sevenWD::GameState& state = pNode->m_gameState.m_gameState;
-	u32 curPlayer = pNode->m_playerTurn;
+	pNode->m_nnHeuristic = computeNNInference(pNode->m_gameState.m_gameState, pNode->m_playerTurn, pNode->m_puctPriors, pContext);
+}
 
+float MCTS_Zero::computeNNInference(const sevenWD::GameState& state, u32 curPlayer, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], void* pContext) const
+{
 	u8 age = (u8)state.getCurrentAge();
 	age = age == u8(-1) ? 0 : age;
 	auto& network = m_network[age];
 
-	const u32 tensorSize = sevenWD::GameState::TensorSize + (network->m_extraTensorData ? sevenWD::GameState::ExtraTensorSize : 0);
-
 #if defined(USE_TINY_DNN)
-	tiny_dnn::vec_t buffer(tensorSize);
-	state.fillTensorData(buffer.data(), curPlayer);
-	if (network->m_extraTensorData)
-		state.fillExtraTensorData(buffer.data() + sevenWD::GameState::TensorSize);
-
 	ThreadContext* pThreadContext = (ThreadContext*)pContext;
 	DEBUG_ASSERT(pThreadContext == nullptr || pThreadContext->m_pThis == this);
-	tiny_dnn::vec_t output = network->forward(buffer, pThreadContext, age);
 
-	float curPlayerWinProbability = output[0];
-	pNode->m_nnHeuristic = curPlayerWinProbability;
-	memcpy(pNode->m_puctPriors, &output[1], sizeof(float) * sevenWD::GameController::cMaxNumMoves);
+	const u64 cacheKey = m_nnCache ? computeNNCacheKey(state, curPlayer) : 0;
+	float curPlayerWinProbability = 0.0f;
+	if (m_nnCache && m_nnCache->find(cacheKey, curPlayerWinProbability, puctPriors)) {
+		return curPlayerWinProbability;
+	}
+
+	BaseNN::Buffers buffers;
+	network->fillInput(state, curPlayer, buffers);
+	network->forward(buffers);
+
+	curPlayerWinProbability = buffers.m_output[0];
+	memcpy(puctPriors, &buffers.m_output[1], sizeof(float) * sevenWD::GameController::cMaxNumMoves);
+	if (m_nnCache) {
+		m_nnCache->store(cacheKey, curPlayerWinProbability, puctPriors);
+	}
+	return curPlayerWinProbability;
 #else
 	DEBUG_ASSERT(false);
+	return 0.0f;
 #endif
 }
 
+u64 MCTS_Zero::computeNNCacheKey(const sevenWD::GameState& state, u32 curPlayer) const
+{
+	// the hash covers the public state, the network input only depends on it
+	u8 age = (u8)state.getCurrentAge();
+	age = age == u8(-1) ? 0 : age;
+	return NNEvalCache::makeKey(state.getHash(), curPlayer, m_network[age]->getGeneration());
+}
+
 void MCTS_Zero::initPUCTPriors(MTCS_Node* pNode, void* pThreadContext, const sevenWD::Move moves[], u32 numMoves) const
 {
-	if (m_useNNHeuristic && !pNode->m_gameState.m_gameState.isDraftingWonders()) {
-		computeNNInference(pNode, pThreadContext);
+	initPUCTPriors(pNode->m_gameState.m_gameState, pNode->m_playerTurn, pNode->m_puctPriors, pNode->m_nnHeuristic, pThreadContext, moves, numMoves);
+}
+
+void MCTS_Zero::initPUCTPriors(const sevenWD::GameState& state, u32 curPlayer, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], float& nnHeuristic,
+	void* pThreadContext, const sevenWD::Move moves[], u32 numMoves) const
+{
+	if (m_useNNHeuristic && !state.isDraftingWonders()) {
+		nnHeuristic = computeNNInference(state, curPlayer, puctPriors, pThreadContext);
 
 	} else {
 		for (u32 i = 0; i < sevenWD::GameController::cMaxNumMoves; ++i) {
-			pNode->m_puctPriors[i] = 1.f / sevenWD::GameController::cMaxNumMoves;
+			puctPriors[i] = 1.f / sevenWD::GameController::cMaxNumMoves;
 		}
 	}
 
+	normalizePUCTPriors(state, puctPriors, moves, numMoves);
+}
+
+void MCTS_Zero::normalizePUCTPriors(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves) const
+{
+	normalizePUCTPriors(pNode->m_gameState.m_gameState, pNode->m_puctPriors, moves, numMoves);
+}
+
+void MCTS_Zero::normalizePUCTPriors(const sevenWD::GameState& state, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], const sevenWD::Move moves[], u32 numMoves) const
+{
 	// Get context from the game state
-	const sevenWD::GameContext* pContext = pNode->m_gameState.m_gameState.m_context;
+	const sevenWD::GameContext* pContext = state.m_context;
 
 	// Mask non valid moves and normalize the output probability
 	float mask[sevenWD::GameController::cMaxNumMoves] = { 0 };
@@ -505,24 +1035,24 @@ void MCTS_Zero::initPUCTPriors(MTCS_Node* pNode, void* pThreadContext, const sev
 		mask[fixedIndex] = 1.0;
 
 		if (moves[i].action == sevenWD::Move::Action::Pick && m_scienceBoost > 0.f) {
-			if (pNode->m_gameState.m_gameState.getPlayableCard(moves[i].playableCard).getType() == sevenWD::CardType::Science) {
-				pNode->m_puctPriors[fixedIndex] += m_scienceBoost;
+			if (state.getPlayableCard(moves[i].playableCard).getType() == sevenWD::CardType::Science) {
+				puctPriors[fixedIndex] += m_scienceBoost;
 			}
 		}
 	}
 
 	float sum = cEpsilon;
 	for (u32 i = 0; i < sevenWD::GameController::cMaxNumMoves; ++i) {
-		sum += pNode->m_puctPriors[i] * mask[i];
+		sum += puctPriors[i] * mask[i];
 	}
 
 	float invSum = 1.0f / sum;
 	for (u32 i = 0; i < sevenWD::GameController::cMaxNumMoves; ++i) {
-		pNode->m_puctPriors[i] = pNode->m_puctPriors[i] * mask[i] * invSum;
+		puctPriors[i] = puctPriors[i] * mask[i] * invSum;
 	}
 }
 
-static std::vector<float> sample_dirichlet(int A, float alpha, std::mt19937& rng) 
+static std::vector<float> sample_dirichlet(int A, float alpha, core::RandomStream& rng) 
 {
 	std::gamma_distribution<float> gamma(alpha, 1.0f);
 	std::vector<float> noise(A);
@@ -540,10 +1070,7 @@ static std::vector<float> sample_dirichlet(int A, float alpha, std::mt19937& rng
 void MCTS_Zero::initRoot(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves, core::LinearAllocator& linAllocator, void* pThreadContext)
 {
 	DEBUG_ASSERT(pNode->m_numChildren == 0);
-	if (numMoves > pNode->m_childrenStorage.size()) {
-		pNode->m_pMoves = new sevenWD::Move[numMoves];
-		pNode->m_children = new MTCS_Node * [numMoves];
-	}
+	pNode->reserveChildren(numMoves, linAllocator);
 
 	for (u32 i = 0; i < numMoves; ++i) {
 		sevenWD::GameController newGameState = pNode->m_gameState;
@@ -555,49 +1082,99 @@ void MCTS_Zero::initRoot(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numM
 
 	pNode->m_numChildren = (u8)numMoves;
 	initPUCTPriors(pNode, pThreadContext, moves, numMoves);
+	if (!useGumbel()) {
+		// the Gumbel root search explores with its own noise
+		addDirichletNoise(pNode, moves, numMoves);
+	}
+}
 
+void MCTS_Zero::addDirichletNoise(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves) const
+{
+	addDirichletNoise(*pNode->m_gameState.m_gameState.m_context, pNode->m_puctPriors, moves, numMoves);
+}
+
+void MCTS_Zero::addDirichletNoise(const sevenWD::GameContext& context, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], const sevenWD::Move moves[], u32 numMoves) const
+{
 	// dirichlet noise to improve exploration for NN prior training
 	if (m_useNNHeuristic && m_useDirichletNoise) {
 		float epsilon = 0.25f;
 		float alpha = 0.3f;
-		std::vector<float> noise = sample_dirichlet(numMoves, alpha, m_rand);
-		// Get context from the game state
-		const sevenWD::GameContext* pContext = pNode->m_gameState.m_gameState.m_context;
+		std::vector<float> noise = sample_dirichlet(numMoves, alpha, context.rand());
 		for (u32 a = 0; a < numMoves; ++a) {
-			u32 id = moves[a].computeMoveFixedIndex(*pContext);
-			pNode->m_puctPriors[id] = (1.0f - epsilon) * pNode->m_puctPriors[id] + epsilon * noise[a];
+			u32 id = moves[a].computeMoveFixedIndex(context);
+			puctPriors[id] = (1.0f - epsilon) * puctPriors[id] + epsilon * noise[a];
 		}
 	}
 }
 
-MTCS_Node* MCTS_Zero::selection(MTCS_Node* pNode, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext)
+MTCS_Node* MCTS_Zero::selection(MTCS_Node* pNode, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext, LeafBatch* pBatch,
+	MCTS_TranspositionTable* pTranspositions)
 {
 	depth++;
 
-	if (pNode->m_gameState.m_winType != sevenWD::WinType::None) {
+	if (pNode->isProven() || pNode->m_pendingNNEval) {
 		return pNode;
 	}
 
 	if (pNode->m_numChildren == 0) {
 		// First time we see this node, initialize it
-		u32 numMoves = (u16)pNode->m_gameState.enumerateMoves(pNode->m_pMoves, (u32)pNode->m_moveStorage.size());
-		if (numMoves > pNode->m_moveStorage.size()) {
-			pNode->m_pMoves = new sevenWD::Move[numMoves];
-			pNode->m_children = new MTCS_Node*[numMoves];
-			pNode->m_gameState.enumerateMoves(pNode->m_pMoves, numMoves);
-		}
+		expandNode(pNode, linAllocator, pThreadContext, pBatch);
+		return pNode;
+	}
 
-		for (u32 i = 0; i < numMoves; ++i) {
-			// Lazy allocation, children are created when selected
-			pNode->m_children[pNode->m_numChildren++] = nullptr;
+	const u32 childIdx = selectChild(pNode);
+	if (pNode->m_children[childIdx] == nullptr) {
+		sevenWD::GameController newGameState = pNode->m_gameState;
+		newGameState.play(pNode->m_pMoves[childIdx]);
+		MTCS_Node* pChildNode = pTranspositions ? pTranspositions->find(newGameState.m_gameState.getHash(), pNode->m_playerTurn) : nullptr;
+		if (pChildNode == nullptr) {
+			pChildNode = linAllocator.allocate<MTCS_Node>(pNode, pNode->m_pMoves[childIdx], newGameState);
+			if (pTranspositions) {
+				pTranspositions->insert(newGameState.m_gameState.getHash(), pNode->m_playerTurn, pChildNode);
+			}
 		}
+		pNode->m_children[childIdx] = pChildNode;
+	}
+
+	MTCS_Node* pChild = pNode->m_children[childIdx];
+	if (pTranspositions) {
+		pChild->m_pParent = pNode;
+	}
+	return selection(pChild, depth, linAllocator, pThreadContext, pBatch, pTranspositions);
+}
 
+void MCTS_Zero::expandNode(MTCS_Node* pNode, core::LinearAllocator& linAllocator, void* pThreadContext, LeafBatch* pBatch)
+{
+	sevenWD::GameController::MoveList moves;
+	pNode->m_gameState.enumerateMoves(moves);
+	u32 numMoves = moves.size();
+	pNode->reserveChildren(numMoves, linAllocator);
+	std::copy(moves.begin(), moves.end(), pNode->m_pMoves);
+
+	for (u32 i = 0; i < numMoves; ++i) {
+		// Lazy allocation, children are created when selected
+		pNode->m_children[pNode->m_numChildren++] = nullptr;
+	}
+
+	if (pBatch && m_useNNHeuristic && !pNode->m_gameState.m_gameState.isDraftingWonders()) {
+		const sevenWD::GameState& state = pNode->m_gameState.m_gameState;
+		if (m_nnCache && m_nnCache->find(computeNNCacheKey(state, pNode->m_playerTurn), pNode->m_nnHeuristic, pNode->m_puctPriors)) {
+			normalizePUCTPriors(pNode, pNode->m_pMoves, numMoves);
+		}
+		else {
+			pNode->m_pendingNNEval = true;
+		}
+	}
+	else {
 		initPUCTPriors(pNode, pThreadContext, pNode->m_pMoves, numMoves);
-		return pNode;
 	}
+}
 
+u32 MCTS_Zero::selectChild(const MTCS_Node* pNode) const
+{
 	float bestPUCT = -1.0f;
 	u32 bestChildIdx = u32(-1);
+	u32 lostChildIdx = u32(-1);
 
 	// Parent visit count for exploration term
 	const float parentVisits = static_cast<float>(pNode->m_visits) + 1.0f;
@@ -606,18 +1183,15 @@ MTCS_Node* MCTS_Zero::selection(MTCS_Node* pNode, u32& depth, core::LinearAlloca
 	const sevenWD::GameContext* pContext = pNode->m_gameState.m_gameState.m_context;
 
 	for (u32 i = 0; i < pNode->m_numChildren; ++i) {
-		MTCS_Node* pChild = pNode->m_children[i];
-
-		if (pChild) {
-			// Early-out: if this child is an immediate win for the player who played it, take it.
-			sevenWD::GameController::State st = pChild->m_gameState.m_gameState.m_state;
-			if (st == sevenWD::GameState::State::WinPlayer0 || st == sevenWD::GameState::State::WinPlayer1) {
-				u32 winner = (st == sevenWD::GameState::State::WinPlayer0) ? 0u : 1u;
-				u32 owner = pNode->m_playerTurn; // player that chose this move
-				if (owner == winner) {
-					return pChild;
-				}
+		const MTCS_Node* pChild = pNode->m_children[i];
+
+		if (pChild && pChild->isProven()) {
+			// Early-out: if this child is a proven win for the player who played it, take it. A proven loss is never worth a visit.
+			if (pChild->getProvenWinner() == pNode->m_playerTurn) {
+				return i;
 			}
+			lostChildIdx = i;
+			continue;
 		}
 
 		const float childVisits = pChild ? static_cast<float>(pChild->m_visits) : 0.0f;
@@ -639,75 +1213,587 @@ MTCS_Node* MCTS_Zero::selection(MTCS_Node* pNode, u32& depth, core::LinearAlloca
 		}
 	}
 
-	if (pNode->m_children[bestChildIdx] == nullptr) {
-		sevenWD::GameController newGameState = pNode->m_gameState;
-		newGameState.play(pNode->m_pMoves[bestChildIdx]);
-		MTCS_Node* pChildNode = linAllocator.allocate<MTCS_Node>(pNode, pNode->m_pMoves[bestChildIdx], newGameState);
-		pNode->m_children[bestChildIdx] = pChildNode;
-	}
-	return selection(pNode->m_children[bestChildIdx], depth, linAllocator, pThreadContext);
+	// only lost moves left, the root of a lost position is proven by visiting one of them
+	return bestChildIdx != u32(-1) ? bestChildIdx : lostChildIdx;
 }
 
-std::pair<float, u32> MCTS_Zero::playout(MTCS_Node* pNode, std::vector<sevenWD::Move>& scratchMoves, void* pThreadContext)
+// Reward of player at the end of a game played randomly from controller
+static float randomRollout(sevenWD::GameController controller, u32 player, sevenWD::GameController::MoveList& scratchMoves)
 {
 	using namespace sevenWD;
 
-	const u32 rootPlayer = pNode->m_playerTurn;
-
-	if (pNode->m_gameState.m_winType != WinType::None) {
-		GameController::State state = pNode->m_gameState.m_gameState.m_state;
-		float reward = (state == GameState::State::WinPlayer0) ? (rootPlayer == 0 ? 1.0f : 0.0f) :
-			(state == GameState::State::WinPlayer1 ? (rootPlayer == 1 ? 1.0f : 0.0f) : 0.0f);
-		return { reward, rootPlayer };
-	}
-
-	if (m_useNNHeuristic) {
-	    return { pNode->m_nnHeuristic, rootPlayer };
-	}
-
-	GameController controller = pNode->m_gameState;
-	bool end = false;
+	core::RandomStream& rng = controller.m_gameState.m_context->rand();
+	bool end = controller.m_winType != WinType::None;
 	scratchMoves.clear();
 	while (!end) {
 		controller.enumerateMoves(scratchMoves);
-		Move move = scratchMoves[m_rand() % scratchMoves.size()];
+		Move move = scratchMoves[rng() % scratchMoves.size()];
 		end = controller.play(move);
 	}
 
-	// compute reward from root player perspective
-	float reward = 0.0f;
-	if (controller.m_gameState.m_state == GameState::State::WinPlayer0 && rootPlayer == 0) {
-		reward = 1.0f;
+	// compute reward from player perspective
+	if (controller.m_gameState.m_state == GameState::State::WinPlayer0 && player == 0) {
+		return 1.0f;
 	}
-	else if (controller.m_gameState.m_state == GameState::State::WinPlayer1 && rootPlayer == 1) {
-		reward = 1.0f;
+	else if (controller.m_gameState.m_state == GameState::State::WinPlayer1 && player == 1) {
+		return 1.0f;
 	}
-	else {
-		reward = 0.0f;
+	return 0.0f;
+}
+
+std::pair<float, u32> MCTS_Zero::playout(MTCS_Node* pNode, sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext)
+{
+	using namespace sevenWD;
+
+	const u32 rootPlayer = pNode->m_playerTurn;
+
+	// finished game or solved subtree, the value is exact
+	if (pNode->isProven()) {
+		return { pNode->getProvenWinner() == rootPlayer ? 1.0f : 0.0f, rootPlayer };
 	}
 
-	return { reward, rootPlayer };
+	if (m_useNNHeuristic) {
+	    return { pNode->m_nnHeuristic, rootPlayer };
+	}
+
+	return { randomRollout(pNode->m_gameState, rootPlayer, scratchMoves), rootPlayer };
 }
 
 void MCTS_Zero::backPropagate(MTCS_Node* pNode, float reward)
 {
 	DEBUG_ASSERT(pNode);
 
+	if (pNode->isProven()) {
+		propagateProven(pNode);
+	}
+
 	const u32 playoutPlayer = pNode->m_playerTurn;
 
 	MTCS_Node* pCur = pNode;
 	while (pCur != nullptr) {
 		// increment visit count for this node
-		pCur->m_visits++;
+		pCur->addVisit();
 
 		// If node has a parent, the parent.currentPlayer is the player who played the move that produced 'pCur'.
 		// Use that owner to decide reward sign: if owner == playoutPlayer use reward, else invert.
 		if (pCur->m_pParent) {
 			const u32 owner = pCur->m_pParent->m_playerTurn;
 			const float valueForOwner = (owner == playoutPlayer) ? reward : (1.0f - reward);
-			pCur->m_totalRewards += valueForOwner;
+			pCur->addReward(valueForOwner);
 		}
 
 		pCur = pCur->m_pParent;
 	}
-}
\ No newline at end of file
+}
+
+MCTS_Zero::LeafBatch::LeafBatch(u32 batchSize)
+{
+	DEBUG_ASSERT(batchSize <= cMaxNNBatchSize);
+	for (u32 age = 0; age < 3; ++age) {
+		m_inputs[age].resize(batchSize * BaseNN::cMaxInputSize);
+		m_outputs[age].resize(batchSize * BaseNN::cMaxOutputSize);
+	}
+}
+
+void MCTS_Zero::LeafBatch::clear()
+{
+	m_leaves.clear();
+	m_numRows[0] = m_numRows[1] = m_numRows[2] = 0;
+}
+
+void MCTS_Zero::addVirtualLoss(MTCS_Node* pNode)
+{
+	// a visit without reward: the path looks like a loss for every player until the real value is known
+	for (MTCS_Node* pCur = pNode; pCur != nullptr; pCur = pCur->m_pParent) {
+		pCur->addVisit();
+	}
+}
+
+void MCTS_Zero::removeVirtualLoss(MTCS_Node* pNode)
+{
+	for (MTCS_Node* pCur = pNode; pCur != nullptr; pCur = pCur->m_pParent) {
+		DEBUG_ASSERT(pCur->m_visits > 0);
+		pCur->removeVisit();
+	}
+}
+
+u32 MCTS_Zero::simulateBatch(MTCS_Node* pRoot, u32 maxSimulations, u32& maxDepth, core::LinearAllocator& linAllocator, LeafBatch& batch,
+	sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext)
+{
+	using namespace sevenWD;
+
+	DEBUG_ASSERT(maxSimulations <= batch.m_leaves.Capacity);
+	batch.clear();
+
+	u32 numSimulations = 0;
+	while (numSimulations < maxSimulations) {
+		u32 depth = 0;
+		MTCS_Node* pSelectedNode = selection(pRoot, depth, linAllocator, pThreadContext, &batch);
+		maxDepth = std::max(depth, maxDepth);
+
+		if (pSelectedNode->m_pendingNNEval) {
+			// The best path leads to a leaf already waiting in this batch, evaluate the batch first
+			auto it = std::find_if(batch.m_leaves.begin(), batch.m_leaves.end(), [&](const LeafBatch::Leaf& leaf) { return leaf.m_pNode == pSelectedNode; });
+			if (it != batch.m_leaves.end()) {
+				break;
+			}
+
+			const GameState& state = pSelectedNode->m_gameState.m_gameState;
+			u8 age = (u8)state.getCurrentAge();
+			age = age == u8(-1) ? 0 : age;
+
+			const u32 row = batch.m_numRows[age]++;
+			m_network[age]->fillInput(state, pSelectedNode->m_playerTurn, batch.m_inputs[age].data() + row * BaseNN::cMaxInputSize);
+			batch.m_leaves.push_back({ pSelectedNode, age, row });
+			addVirtualLoss(pSelectedNode);
+		}
+		else {
+			// Finished game or position evaluated without the network, its value is already known
+			auto [reward, simPlayer] = playout(pSelectedNode, scratchMoves, pThreadContext);
+			DEBUG_ASSERT(simPlayer == pSelectedNode->m_playerTurn);
+			backPropagate(pSelectedNode, reward);
+		}
+		numSimulations++;
+	}
+
+	// The first selection of a batch cannot hit a pending leaf
+	DEBUG_ASSERT(numSimulations > 0);
+
+	for (u32 age = 0; age < 3; ++age) {
+		if (batch.m_numRows[age] > 0) {
+			m_network[age]->forwardBatch(batch.m_inputs[age].data(), batch.m_outputs[age].data(), batch.m_numRows[age]);
+		}
+	}
+
+	for (const LeafBatch::Leaf& leaf : batch.m_leaves) {
+		MTCS_Node* pLeaf = leaf.m_pNode;
+		const float* output = batch.m_outputs[leaf.m_age].data() + leaf.m_row * BaseNN::cMaxOutputSize;
+
+		pLeaf->m_nnHeuristic = output[0];
+		memcpy(pLeaf->m_puctPriors, output + 1, sizeof(float) * GameController::cMaxNumMoves);
+		if (m_nnCache) {
+			m_nnCache->store(computeNNCacheKey(pLeaf->m_gameState.m_gameState, pLeaf->m_playerTurn), pLeaf->m_nnHeuristic, pLeaf->m_puctPriors);
+		}
+		normalizePUCTPriors(pLeaf, pLeaf->m_pMoves, pLeaf->m_numChildren);
+		pLeaf->m_pendingNNEval = false;
+
+		removeVirtualLoss(pLeaf);
+		backPropagate(pLeaf, pLeaf->m_nnHeuristic);
+	}
+
+	return numSimulations;
+}
+
+MTCS_Node* MCTS_Zero::selectionShared(MTCS_Node* pRoot, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext)
+{
+	MTCS_Node* pNode = pRoot;
+	while (true) {
+		depth++;
+		// virtual loss, the reward is added by backPropagateShared() so the other threads avoid this path meanwhile
+		pNode->addVisitShared();
+
+		if (pNode->isProven()) {
+			return pNode;
+		}
+
+		u8 state = pNode->m_expandState.load(std::memory_order_acquire);
+		if (state != MTCS_Node::Expanded) {
+			if (state == MTCS_Node::NotExpanded && pNode->m_expandState.compare_exchange_strong(state, MTCS_Node::Expanding, std::memory_order_acquire)) {
+				expandNode(pNode, linAllocator, pThreadContext, nullptr);
+				pNode->m_expandState.store(MTCS_Node::Expanded, std::memory_order_release);
+				return pNode;
+			}
+
+			// another thread is expanding this node, give the path back and let the caller retry
+			for (MTCS_Node* pCur = pNode; pCur != nullptr; pCur = pCur->m_pParent) {
+				pCur->removeVisitShared();
+			}
+			return nullptr;
+		}
+
+		const u32 childIdx = selectChild(pNode);
+		MTCS_Node* pChild = pNode->m_children[childIdx].load(std::memory_order_acquire);
+		if (pChild == nullptr) {
+			sevenWD::GameController newGameState = pNode->m_gameState;
+			newGameState.play(pNode->m_pMoves[childIdx]);
+			MTCS_Node* pNewChild = linAllocator.allocate<MTCS_Node>(pNode, pNode->m_pMoves[childIdx], newGameState);
+			if (pNode->m_children[childIdx].compare_exchange_strong(pChild, pNewChild, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				pChild = pNewChild;
+			}
+			else {
+				// created concurrently by another thread, pChild now holds its node and ours stays unused in the allocator
+				pNewChild->cleanup();
+			}
+		}
+		pNode = pChild;
+	}
+}
+
+void MCTS_Zero::backPropagateShared(MTCS_Node* pNode, float reward)
+{
+	DEBUG_ASSERT(pNode);
+
+	if (pNode->isProven()) {
+		propagateProven(pNode);
+	}
+
+	// the visits were counted during the selection
+	const u32 playoutPlayer = pNode->m_playerTurn;
+	for (MTCS_Node* pCur = pNode; pCur->m_pParent != nullptr; pCur = pCur->m_pParent) {
+		const u32 owner = pCur->m_pParent->m_playerTurn;
+		const float valueForOwner = (owner == playoutPlayer) ? reward : (1.0f - reward);
+		pCur->addRewardShared(valueForOwner);
+	}
+}
+
+u32 MCTS_Zero::searchTreeParallel(MTCS_Node* pRoot, u32 numIterations, const core::Deadline& deadline,
+	std::vector<std::unique_ptr<core::LinearAllocator>>& allocators, void* pThreadContext)
+{
+	using namespace sevenWD;
+
+	DEBUG_ASSERT(m_useMT && pRoot->m_numChildren > 0);
+	pRoot->m_expandState.store(MTCS_Node::Expanded, std::memory_order_release);
+
+	std::atomic<u32> nextIteration = 0;
+	std::atomic<u32> maxDepth = 0;
+	const GameContext& context = *pRoot->m_gameState.m_gameState.m_context;
+	const u64 treeStream = context.rand()();
+
+	auto processThreads = [&](u32 start, u32 end)
+	{
+		for (u32 t = start; t < end; ++t) {
+			const ScopedRandStream threadStream(context, treeStream + t);
+			GameController::MoveList scratchMoves;
+			u32 threadMaxDepth = 0;
+
+			while (true) {
+				// one tree for all the threads, the iterations are numbered by a shared counter: the first one runs even past
+				// the deadline so the root has visits, then every thread stops at the budget, the deadline or a solved root
+				const u32 iter = nextIteration.fetch_add(1, std::memory_order_relaxed);
+				if (iter >= numIterations || (iter > 0 && (pRoot->isProven() || deadline.hasExpired()))) {
+					break;
+				}
+
+				u32 depth = 0;
+				MTCS_Node* pSelectedNode = selectionShared(pRoot, depth, *allocators[t], pThreadContext);
+				while (pSelectedNode == nullptr) {
+					std::this_thread::yield();
+					depth = 0;
+					pSelectedNode = selectionShared(pRoot, depth, *allocators[t], pThreadContext);
+				}
+
+				auto [reward, simPlayer] = playout(pSelectedNode, scratchMoves, pThreadContext);
+				DEBUG_ASSERT(simPlayer == pSelectedNode->m_playerTurn);
+				backPropagateShared(pSelectedNode, reward);
+				threadMaxDepth = std::max(depth, threadMaxDepth);
+			}
+
+			u32 curMaxDepth = maxDepth.load();
+			while (threadMaxDepth > curMaxDepth && !maxDepth.compare_exchange_weak(curMaxDepth, threadMaxDepth)) {}
+		}
+
+		if (m_nnCache) {
+			m_nnCache->flushStats();
+		}
+	};
+
+	const u32 numThreads = (u32)allocators.size();
+	core::parallelFor(0u, numThreads, processThreads, numThreads);
+	return maxDepth.load();
+}
+
+// --------------------------------------------------- //
+// ----------------- MCTS_Zero, Gumbel --------------- //
+// --------------------------------------------------- //
+static float gumbelSigma(float q, u32 maxVisits)
+{
+	return (MCTS_Zero::cGumbelVisitScale + (float)maxVisits) * MCTS_Zero::cGumbelValueScale * q;
+}
+
+u32 MCTS_Zero::searchGumbel(MTCS_Node* pRoot, u32 numIterations, const core::Deadline& deadline, u32& maxDepth, core::LinearAllocator& linAllocator,
+	sevenWD::GameController::MoveList& scratchMoves, MCTS_TranspositionTable* pTranspositions, void* pThreadContext)
+{
+	using namespace sevenWD;
+
+	const GameContext& context = *pRoot->m_gameState.m_gameState.m_context;
+	const u32 numChildren = pRoot->m_numChildren;
+	DEBUG_ASSERT(numChildren > 0 && numChildren <= GameController::cMaxMoveListSize);
+
+	// Gumbel-top-k trick: the k best g + logits are k moves sampled without replacement from the priors
+	std::extreme_value_distribution<float> gumbelDistribution(0.0f, 1.0f);
+	float gumbelLogits[GameController::cMaxMoveListSize];
+	u32 candidates[GameController::cMaxMoveListSize];
+	for (u32 i = 0; i < numChildren; ++i) {
+		const float prior = pRoot->m_puctPriors[pRoot->m_pMoves[i].computeMoveFixedIndex(context)];
+		gumbelLogits[i] = gumbelDistribution(context.rand()) + logf(std::max(prior, cEpsilon));
+		candidates[i] = i;
+	}
+
+	u32 numCandidates = std::min(m_gumbelNumConsidered, numChildren);
+	std::partial_sort(candidates, candidates + numCandidates, candidates + numChildren,
+		[&](u32 a, u32 b) { return gumbelLogits[a] > gumbelLogits[b]; });
+
+	// best candidates first according to g + logits + sigma(completed Q)
+	auto rankCandidates = [&]() {
+		float completedQ[GameController::cMaxMoveListSize];
+		float policy[GameController::cMaxMoveListSize];
+		computeGumbelPolicy(pRoot, completedQ, policy);
+		u32 maxVisits = 0;
+		for (u32 i = 0; i < numChildren; ++i) {
+			maxVisits = std::max(maxVisits, pRoot->m_children[i].load()->m_visits.load());
+		}
+		std::sort(candidates, candidates + numCandidates, [&](u32 a, u32 b) {
+			return gumbelLogits[a] + gumbelSigma(completedQ[a], maxVisits) > gumbelLogits[b] + gumbelSigma(completedQ[b], maxVisits);
+		});
+	};
+
+	// sequential halving: ceil(log2(k)) phases share the budget, each one visits its candidates evenly and keeps the best half
+	u32 numPhases = 1;
+	while ((1u << numPhases) < numCandidates) {
+		++numPhases;
+	}
+
+	u32 iter = 0;
+	// the phases share the iteration budget. The first simulation runs even past the deadline so a candidate has a
+	// value, then the halving stops early once the root is solved or the deadline passes and ranks what it has.
+	auto canSimulate = [&]() { return iter < numIterations && (iter == 0 || (!pRoot->isProven() && !deadline.hasExpired())); };
+	for (u32 phase = 0; phase < numPhases && canSimulate(); ++phase) {
+		const u32 visitsPerCandidate = std::max(1u, (numIterations - iter) / ((numPhases - phase) * numCandidates));
+		for (u32 v = 0; v < visitsPerCandidate && canSimulate(); ++v) {
+			for (u32 c = 0; c < numCandidates && canSimulate(); ++c, ++iter) {
+				u32 depth = 1;
+				MTCS_Node* pSelectedNode = selection(pRoot->m_children[candidates[c]], depth, linAllocator, pThreadContext, nullptr, pTranspositions);
+				auto [reward, simPlayer] = playout(pSelectedNode, scratchMoves, pThreadContext);
+				DEBUG_ASSERT(simPlayer == pSelectedNode->m_playerTurn);
+				backPropagate(pSelectedNode, reward);
+				maxDepth = std::max(depth, maxDepth);
+			}
+		}
+
+		rankCandidates();
+		numCandidates = (numCandidates + 1) / 2;
+	}
+
+	// budget or deadline reached before the last phase
+	rankCandidates();
+	return candidates[0];
+}
+
+void MCTS_Zero::computeGumbelPolicy(const MTCS_Node* pRoot, float (&completedQ)[sevenWD::GameController::cMaxMoveListSize],
+	float (&policy)[sevenWD::GameController::cMaxMoveListSize]) const
+{
+	const sevenWD::GameContext& context = *pRoot->m_gameState.m_gameState.m_context;
+	const u32 numChildren = pRoot->m_numChildren;
+
+	// mixed value: the root value and the prior weighted Q of the visited children, weighted by their visits
+	float logits[sevenWD::GameController::cMaxMoveListSize];
+	u32 sumVisits = 0;
+	u32 maxVisits = 0;
+	float sumVisitedPriors = 0.0f;
+	float sumVisitedQ = 0.0f;
+	for (u32 i = 0; i < numChildren; ++i) {
+		const MTCS_Node* pChild = pRoot->m_children[i];
+		const float prior = pRoot->m_puctPriors[pRoot->m_pMoves[i].computeMoveFixedIndex(context)];
+		logits[i] = logf(std::max(prior, cEpsilon));
+		if (pChild->m_visits > 0) {
+			sumVisits += pChild->m_visits;
+			maxVisits = std::max(maxVisits, pChild->m_visits.load());
+			sumVisitedPriors += prior;
+			sumVisitedQ += prior * pChild->m_totalRewards / pChild->m_visits;
+		}
+	}
+
+	const float rootValue = m_useNNHeuristic ? pRoot->m_nnHeuristic : 0.5f;
+	float mixedValue = rootValue;
+	if (sumVisits > 0) {
+		mixedValue = (rootValue + (float)sumVisits * sumVisitedQ / std::max(sumVisitedPriors, cEpsilon)) / (1.0f + (float)sumVisits);
+	}
+
+	for (u32 i = 0; i < numChildren; ++i) {
+		const MTCS_Node* pChild = pRoot->m_children[i];
+		completedQ[i] = pChild->m_visits > 0 ? pChild->m_totalRewards / pChild->m_visits : mixedValue;
+		policy[i] = logits[i] + gumbelSigma(completedQ[i], maxVisits);
+	}
+
+	const float maxLogit = *std::max_element(policy, policy + numChildren);
+	float sum = 0.0f;
+	for (u32 i = 0; i < numChildren; ++i) {
+		policy[i] = expf(policy[i] - maxLogit);
+		sum += policy[i];
+	}
+	for (u32 i = 0; i < numChildren; ++i) {
+		policy[i] /= sum;
+	}
+}
+
+// --------------------------------------------------- //
+// ----------------- MCTS_Zero, ISMCTS --------------- //
+// --------------------------------------------------- //
+std::pair<sevenWD::Move, float> MCTS_Zero::selectMoveISMCTS(const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext)
+{
+	using namespace sevenWD;
+
+	const GameContext& context = *_game.m_gameState.m_context;
+	core::LinearAllocator& linAllocator = MCTS_Arena::acquire();
+	GameController::MoveList scratchMoves;
+	std::vector<std::pair<ISMCTS_Node*, ISMCTS_Node::Edge*>> path;
+
+	// the moves of the root do not depend on the hidden cards, its edges follow _moves
+	// future ages of the determinization of the current iteration, the nodes keep no game state
+	GameState::DeterminizedSetup determinizedSetup;
+
+	ISMCTS_Node* pRoot = linAllocator.allocate<ISMCTS_Node>(_game);
+	{
+		GameController game = _game;
+		game.m_gameState.makeDeterministic(determinizedSetup);
+		expandISMCTS(pRoot, game, _moves.data(), (u32)_moves.size(), linAllocator, pThreadContext);
+		addDirichletNoise(context, pRoot->m_puctPriors, _moves.data(), (u32)_moves.size());
+	}
+
+	const core::Deadline deadline(m_timeBudgetMs);
+	const u32 numIterations = m_numMoves * m_numSampling;
+	for (u32 iter = 0; iter < numIterations && (iter == 0 || !deadline.hasExpired()); ++iter) {
+		GameController game = _game;
+		game.m_gameState.makeDeterministic(determinizedSetup);
+
+		// descend while the information sets are expanded
+		path.clear();
+		ISMCTS_Node* pNode = pRoot;
+		while (pNode->m_isExpanded) {
+			game.enumerateMoves(scratchMoves);
+			ISMCTS_Node::Edge* pEdge = selectEdgeISMCTS(pNode, scratchMoves, context, linAllocator);
+			path.push_back({ pNode, pEdge });
+			game.play(pEdge->m_move);
+
+			// the public state reached depends on the cards revealed by the determinization
+			ISMCTS_Node* pChild = pEdge->findOutcome(game.m_gameState.getHash());
+			if (pChild == nullptr) {
+				pChild = linAllocator.allocate<ISMCTS_Node>(game);
+				pChild->m_pNextOutcome = pEdge->m_pOutcomes;
+				pEdge->m_pOutcomes = pChild;
+			}
+			pNode = pChild;
+
+			if (pNode->isTerminal()) {
+				break;
+			}
+		}
+
+		// reward of leafPlayer
+		u32 leafPlayer = pNode->m_playerTurn;
+		float reward = 0.0f;
+		if (pNode->isTerminal()) {
+			leafPlayer = pNode->m_winner;
+			reward = 1.0f;
+		}
+		else {
+			game.enumerateMoves(scratchMoves);
+			expandISMCTS(pNode, game, scratchMoves.data(), scratchMoves.size(), linAllocator, pThreadContext);
+			reward = (m_useNNHeuristic && !game.m_gameState.isDraftingWonders()) ? pNode->m_nnHeuristic : randomRollout(game, leafPlayer, scratchMoves);
+		}
+
+		pNode->m_visits++;
+		for (auto [pPathNode, pEdge] : path) {
+			pPathNode->m_visits++;
+			pEdge->m_visits++;
+			pEdge->m_totalRewards += (pPathNode->m_playerTurn == leafPlayer) ? reward : (1.0f - reward);
+		}
+	}
+
+	// select the most visited move, the visits of the root edges give the PUCT priors
+	float puctPriors[GameController::cMaxNumMoves] = { 0 };
+	const ISMCTS_Node::Edge* pBestEdge = pRoot->m_pEdges;
+	u32 bestIndex = 0;
+	for (u32 i = 0; i < _moves.size(); ++i) {
+		const ISMCTS_Node::Edge* pEdge = pRoot->findEdge(_moves[i]);
+		DEBUG_ASSERT(pEdge);
+		puctPriors[_moves[i].computeMoveFixedIndex(context)] = (float)pEdge->m_visits / std::max(1u, pRoot->m_visits);
+		if (pEdge->m_visits > pBestEdge->m_visits) {
+			pBestEdge = pEdge;
+			bestIndex = i;
+		}
+	}
+
+	if (pThreadContext) {
+		ThreadContext* pTC = (ThreadContext*)pThreadContext;
+		memcpy(pTC->m_puctPriors, puctPriors, sizeof(puctPriors));
+	}
+
+	const float score = pBestEdge->m_visits > 0 ? pBestEdge->m_totalRewards / pBestEdge->m_visits : 0.5f;
+	if (m_nnCache) {
+		m_nnCache->flushStats();
+	}
+	MCTS_Arena::release(linAllocator);
+	return { _moves[bestIndex], score };
+}
+
+void MCTS_Zero::expandISMCTS(ISMCTS_Node* pNode, const sevenWD::GameController& game, const sevenWD::Move moves[], u32 numMoves,
+	core::LinearAllocator& linAllocator, void* pThreadContext) const
+{
+	DEBUG_ASSERT(!pNode->m_isExpanded && !pNode->isTerminal());
+
+	ISMCTS_Node::Edge** ppNext = &pNode->m_pEdges;
+	for (u32 i = 0; i < numMoves; ++i) {
+		*ppNext = linAllocator.allocate<ISMCTS_Node::Edge>(moves[i]);
+		ppNext = &(*ppNext)->m_pNext;
+	}
+
+	initPUCTPriors(game.m_gameState, pNode->m_playerTurn, pNode->m_puctPriors, pNode->m_nnHeuristic, pThreadContext, moves, numMoves);
+	pNode->m_isExpanded = true;
+}
+
+ISMCTS_Node::Edge* MCTS_Zero::selectEdgeISMCTS(ISMCTS_Node* pNode, const sevenWD::GameController::MoveList& moves, const sevenWD::GameContext& context,
+	core::LinearAllocator& linAllocator) const
+{
+	// every legal move counts as available, before the early-out can end the selection
+	ISMCTS_Node::Edge* edges[sevenWD::GameController::cMaxMoveListSize];
+
+	// edges are created in the order of the moves, which rarely changes from one determinization to the next
+	ISMCTS_Node::Edge* pExpected = pNode->m_pEdges;
+	for (u32 i = 0; i < moves.size(); ++i) {
+		const sevenWD::Move& move = moves[i];
+		ISMCTS_Node::Edge* pEdge = (pExpected && pExpected->m_move == move) ? pExpected : pNode->findEdge(move);
+		if (pEdge == nullptr) {
+			// move illegal in the determinizations seen so far, its prior was masked: only its value can select it
+			pEdge = linAllocator.allocate<ISMCTS_Node::Edge>(move);
+			ISMCTS_Node::Edge** ppLast = &pNode->m_pEdges;
+			while (*ppLast) {
+				ppLast = &(*ppLast)->m_pNext;
+			}
+			*ppLast = pEdge;
+		}
+		pExpected = pEdge->m_pNext;
+		pEdge->m_availability++;
+		edges[i] = pEdge;
+	}
+
+	float bestPUCT = -1.0f;
+	ISMCTS_Node::Edge* pBestEdge = nullptr;
+	for (u32 i = 0; i < moves.size(); ++i) {
+		ISMCTS_Node::Edge* pEdge = edges[i];
+
+		// Early-out: if this move led to a win of the player to move, take it.
+		for (const ISMCTS_Node* pOutcome = pEdge->m_pOutcomes; pOutcome != nullptr; pOutcome = pOutcome->m_pNextOutcome) {
+			if (pOutcome->m_winner == pNode->m_playerTurn) {
+				return pEdge;
+			}
+		}
+
+		// Q(s,a) from this node's perspective, 50/50 for unvisited moves
+		const float edgeVisits = static_cast<float>(pEdge->m_visits);
+		const float qValue = (pEdge->m_visits == 0) ? 0.5f : pEdge->m_totalRewards / edgeVisits;
+		const float prior = pNode->m_puctPriors[pEdge->m_move.computeMoveFixedIndex(context)];
+
+		// U(s,a): the move was only available in part of the parent visits
+		const float uValue = C * prior * sqrtf(static_cast<float>(pEdge->m_availability)) / (1.0f + edgeVisits);
+
+		const float puct = qValue + uValue;
+		if (puct > bestPUCT) {
+			bestPUCT = puct;
+			pBestEdge = pEdge;
+		}
+	}
+
+	DEBUG_ASSERT(pBestEdge);
+	return pBestEdge;
+}
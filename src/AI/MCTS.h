@@ -1,6 +1,10 @@
 #pragma once
 #include "ML.h"
 #include "Core/LinearAllocator.h"
+#include "Core/FixedVector.h"
+#include "Core/Deadline.h"
+#include "Core/Scheduler.h"
+#include "NNEvalCache.h"
 
 struct MCTS_Simple : BaseNetworkAI
 {
@@ -23,7 +27,11 @@ struct MTCS_Node {
 		, m_move_from_parent(moveFromParent)
 		, m_gameState(_gamestate)
 		, m_playerTurn((u8)_gamestate.m_gameState.getCurrentPlayerTurn())
-	{}
+	{
+		if (_gamestate.m_winType != sevenWD::WinType::None) {
+			m_provenWinner = _gamestate.m_gameState.m_state == sevenWD::GameState::State::WinPlayer0 ? 0 : 1;
+		}
+	}
 
 	MTCS_Node* m_pParent = nullptr;
 	sevenWD::Move m_move_from_parent{};
@@ -32,36 +40,217 @@ struct MTCS_Node {
 	std::array<sevenWD::Move, 24> m_moveStorage;
 	sevenWD::Move* m_pMoves = m_moveStorage.data();
 	
-	std::array<MTCS_Node*, 24> m_childrenStorage;
-	MTCS_Node** m_children = m_childrenStorage.data();
+	// Atomic for the lazy child creation of the tree-parallel search, plain loads and stores elsewhere
+	std::array<std::atomic<MTCS_Node*>, 24> m_childrenStorage;
+	std::atomic<MTCS_Node*>* m_children = m_childrenStorage.data();
 
 	u16 m_numUnexploredMoves = 0;
 	u8 m_numChildren = 0;
 	u8 m_playerTurn = 0;
+	bool m_pendingNNEval = false; // expanded, priors and value wait for the batched network evaluation
+
+	// Expansion state of the tree-parallel search, the children, moves and priors are published by Expanded
+	enum ExpandState : u8 { NotExpanded, Expanding, Expanded };
+	std::atomic<u8> m_expandState = NotExpanded;
+
+	// MCTS-Solver: winner of the position once proven (finished game or solved subtree of the determinization)
+	static constexpr u8 cUnproven = u8(-1);
+	std::atomic<u8> m_provenWinner = cUnproven;
 
 	float m_nnHeuristic = 0.0f;
-	u32 m_visits = 0;
-	float m_totalRewards = 0;
+	std::atomic<u32> m_visits = 0;
+	std::atomic<float> m_totalRewards = 0.0f;
 	float m_puctPriors[sevenWD::GameController::cMaxNumMoves] = { 0.0f };
 
-	void cleanup() {
-		if (m_pMoves != m_moveStorage.data()) {
-			delete[] m_pMoves;
+	// Moves and children beyond the inline storage come from the tree allocator, they are released with the nodes
+	void reserveChildren(u32 numMoves, core::LinearAllocator& linAllocator) {
+		DEBUG_ASSERT(numMoves <= sevenWD::GameController::cMaxMoveListSize);
+		if (numMoves > m_moveStorage.size()) {
+			m_pMoves = static_cast<sevenWD::Move*>(linAllocator.allocate(sizeof(sevenWD::Move) * numMoves));
+			m_children = static_cast<std::atomic<MTCS_Node*>*>(linAllocator.allocate(sizeof(std::atomic<MTCS_Node*>) * numMoves));
+			for (u32 i = 0; i < numMoves; ++i) {
+				new(&m_children[i]) std::atomic<MTCS_Node*>(nullptr);
+			}
+		}
+	}
+
+	// Statistics of a tree owned by a single thread: relaxed loads and stores, no locked instruction
+	void addVisit() { m_visits.store(m_visits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+	void removeVisit() { m_visits.store(m_visits.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed); }
+	void addReward(float reward) { m_totalRewards.store(m_totalRewards.load(std::memory_order_relaxed) + reward, std::memory_order_relaxed); }
+
+	// Statistics of a tree shared by several threads
+	void addVisitShared() { m_visits.fetch_add(1, std::memory_order_relaxed); }
+	void removeVisitShared() { m_visits.fetch_sub(1, std::memory_order_relaxed); }
+	void addRewardShared(float reward) {
+		float total = m_totalRewards.load(std::memory_order_relaxed);
+		while (!m_totalRewards.compare_exchange_weak(total, total + reward, std::memory_order_relaxed)) {}
+	}
+
+	bool isProven() const { return getProvenWinner() != cUnproven; }
+	u8 getProvenWinner() const { return m_provenWinner.load(std::memory_order_relaxed); }
+	void setProvenWinner(u8 winner) { m_provenWinner.store(winner, std::memory_order_relaxed); }
+
+	void cleanup() { cleanupExcept(nullptr); }
+
+	// Releases the tree except the subtree of pKeep, which stays valid.
+	// A node shared by transpositions is released once.
+	void cleanupExcept(const MTCS_Node* pKeep) {
+		if (this == pKeep) {
+			return;
 		}
 		for (u32 i = 0; i < m_numChildren; ++i) {
 			if (m_children[i]) {
-				m_children[i]->cleanup();
+				m_children[i].load()->cleanupExcept(pKeep);
 			}
 		}
-		if (m_children != m_childrenStorage.data()) {
-			delete[] m_children;
-		}
+		m_numChildren = 0;
 		m_children = nullptr;
 		m_pMoves = nullptr;
 	}
 };
 
-class thread_pool;
+// Search trees kept from one move to the next, one per sampled determinization.
+// The node matching the new position becomes the root: the hash only covers the public state, so a match means the
+// cards revealed in the meantime agree with the determinization, otherwise the tree is dropped.
+struct MCTS_TreeCache {
+	static constexpr u32 cMaxSearchDepth = 4; // plies played between two searches (replay wonders, wonder draft)
+	static constexpr size_t cPageSize = 1024 * 1024;
+	static constexpr size_t cMaxTreeSize = 32 * 1024 * 1024; // a bigger tree is dropped rather than growing further
+
+	struct Tree {
+		std::unique_ptr<core::LinearAllocator> m_allocator;
+		MTCS_Node* m_pRoot = nullptr;
+	};
+
+	~MCTS_TreeCache() { clear(); }
+
+	void resize(u32 numTrees);
+	void clear();
+
+	// Node of tree i matching _game with children for exactly _moves, in that order, the rest of the tree is released.
+	// Returns nullptr when the tree cannot be reused, its allocator is then empty.
+	MTCS_Node* takeRoot(u32 i, const sevenWD::GameController& _game, const sevenWD::Move moves[], u32 numMoves);
+	core::LinearAllocator& getAllocator(u32 i);
+	void keepRoot(u32 i, MTCS_Node* pRoot) { m_trees[i].m_pRoot = pRoot; }
+
+	// A tree this big may take one more iteration but not a round of them and still be reused
+	static bool isFull(const core::LinearAllocator& allocator) { return allocator.getUsedSize() + cPageSize > cMaxTreeSize; }
+	// Every tree is kept and either solved or full, a pondering search cannot grow them further
+	bool isComplete() const;
+
+	std::vector<Tree> m_trees;
+
+private:
+	void dropTree(Tree& tree);
+	static MTCS_Node* findNode(MTCS_Node* pNode, u64 hash, u32 depth);
+	static bool setRootChildren(MTCS_Node* pRoot, const sevenWD::Move moves[], u32 numMoves, core::LinearAllocator& linAllocator);
+};
+
+// Thread context of the MCTS AIs reusing their trees
+struct MCTS_ThreadContext : BaseNetworkAI::ThreadContext {
+	using ThreadContext::ThreadContext;
+	~MCTS_ThreadContext() override; // stops the background search
+
+	MCTS_TreeCache m_treeCache;
+	core::TaskGroup m_ponderTask; // background search of MCTS_Zero::startPondering
+	bool m_isPondering = false; // set during the background search, its rounds ignore the time budget
+	std::atomic<bool> m_stopSearch = false; // ends the searches using this context early
+};
+
+// Node arenas of the searches dropping their tree, owned by the thread running the search and kept from one search to
+// the next. The largest tree is recorded so the page size and the tree budgets can be chosen from data.
+struct MCTS_Arena {
+	static constexpr size_t cPageSize = 8 * 1024 * 1024;
+	static constexpr size_t cMaxKeptSize = 64 * 1024 * 1024; // an arena that grew beyond gives its pages back
+
+	// Empty arena of the calling thread, to release() at the end of the search
+	static core::LinearAllocator& acquire();
+	// Empty arenas of the threads sharing a tree, owned by the calling thread, to release() at the end of the search
+	static std::vector<std::unique_ptr<core::LinearAllocator>>& acquireShared(u32 numArenas);
+	static void release(core::LinearAllocator& arena);
+	static void release(std::vector<std::unique_ptr<core::LinearAllocator>>& arenas);
+
+	// Largest tree built by a search (bytes) since the start or the last resetStats()
+	static size_t getHighWaterMark();
+	static void resetStats();
+};
+
+// Nodes of one determinization tree keyed by position, so the move orders reaching the same position share their node
+// and statistics (UCT on a DAG). Within a determinization the public hash identifies the position, the table is cleared
+// with its tree. It never grows past its memory budget, positions beyond it get distinct nodes.
+struct MCTS_TranspositionTable {
+	static constexpr size_t cSlotSize = sizeof(std::pair<u64, MTCS_Node*>) + sizeof(u64); // flat_hash_map slot, probe distance included
+
+	explicit MCTS_TranspositionTable(size_t memoryBudget);
+
+	// Node reached by a move of player owner, the rewards of a node are stored from the point of view of that player
+	MTCS_Node* find(u64 hash, u32 owner) const;
+	void insert(u64 hash, u32 owner, MTCS_Node* pNode);
+	void clear() { m_nodes.clear(); }
+
+private:
+	static u64 makeKey(u64 hash, u32 owner) { return hash ^ (owner * 0x9E3779B97F4A7C15ull); }
+
+	core::flat_hash_map<u64, MTCS_Node*> m_nodes;
+	size_t m_maxNumNodes = 0;
+};
+
+// Node of the single tree information set search (MCTS_Zero::m_useISMCTS): one public state, shared by every
+// determinization reaching it. Each iteration replays its own determinization, nodes only keep statistics.
+struct ISMCTS_Node {
+
+	struct Edge {
+		explicit Edge(const sevenWD::Move& move) : m_move(move) {}
+
+		sevenWD::Move m_move;
+		u32 m_visits = 0;
+		u32 m_availability = 0; // iterations where the move was legal in the sampled determinization
+		float m_totalRewards = 0.0f; // from the point of view of the player choosing the move
+		ISMCTS_Node* m_pOutcomes = nullptr; // one child per public state reached, a move can reveal different cards
+		Edge* m_pNext = nullptr;
+
+		ISMCTS_Node* findOutcome(u64 hash) const {
+			for (ISMCTS_Node* pOutcome = m_pOutcomes; pOutcome != nullptr; pOutcome = pOutcome->m_pNextOutcome) {
+				if (pOutcome->m_hash == hash) {
+					return pOutcome;
+				}
+			}
+			return nullptr;
+		}
+	};
+
+	explicit ISMCTS_Node(const sevenWD::GameController& _game)
+		: m_hash(_game.m_gameState.getHash())
+		, m_playerTurn((u8)_game.m_gameState.getCurrentPlayerTurn())
+	{
+		if (_game.m_winType != sevenWD::WinType::None) {
+			m_winner = _game.m_gameState.m_state == sevenWD::GameState::State::WinPlayer0 ? 0 : 1;
+		}
+	}
+
+	Edge* findEdge(const sevenWD::Move& move) const {
+		for (Edge* pEdge = m_pEdges; pEdge != nullptr; pEdge = pEdge->m_pNext) {
+			if (pEdge->m_move == move) {
+				return pEdge;
+			}
+		}
+		return nullptr;
+	}
+
+	bool isTerminal() const { return m_winner != u8(-1); }
+
+	u64 m_hash = 0;
+	ISMCTS_Node* m_pNextOutcome = nullptr;
+	Edge* m_pEdges = nullptr; // created at expansion, moves only legal in later determinizations are appended
+	u32 m_visits = 0;
+	u8 m_playerTurn = 0;
+	u8 m_winner = u8(-1);
+	bool m_isExpanded = false;
+	float m_nnHeuristic = 0.0f;
+	float m_puctPriors[sevenWD::GameController::cMaxNumMoves] = { 0.0f };
+};
+
 struct MCTS_Deterministic : BaseNetworkAI
 {
 	enum HeuristicType {
@@ -70,11 +259,12 @@ struct MCTS_Deterministic : BaseNetworkAI
 		Heuristic_NoBurnRollout,
 	};
 
-	std::mt19937 m_rand{ (u32)time(nullptr) };
-	thread_pool* m_threadPool = nullptr;
+	bool m_useMT = false; // run the samplings on core::Scheduler
 	u32 m_numMoves = 1000;
 	u32 m_numSampling = 50;
 	HeuristicType m_heuristic = Heuristic_RandomRollout;
+	bool m_reuseTree = false; // keep the searched subtrees for the next move (needs a thread context)
+	u32 m_timeBudgetMs = 0; // > 0: wall clock budget per move, m_numMoves is then an upper bound
 
 	float C = sqrtf(2.0f);
 	static constexpr float cEpsilon = 1e-5f;
@@ -84,26 +274,31 @@ struct MCTS_Deterministic : BaseNetworkAI
 
 	std::string getName() const override {
 		if (m_heuristic == Heuristic_UseDNN) {
-			return std::string("MCTS_Deterministic_DNN") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling);
+			return std::string("MCTS_Deterministic_DNN") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling) + (m_reuseTree ? "_r" : "")
+				+ (m_timeBudgetMs > 0 ? "_t" + std::to_string(m_timeBudgetMs) : "");
 		}
 		else {
-			return std::string((m_heuristic == Heuristic_NoBurnRollout) ? "MCTS_DeterministicNoBurn" : "MCTS_Deterministic") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling);
+			return std::string((m_heuristic == Heuristic_NoBurnRollout) ? "MCTS_DeterministicNoBurn" : "MCTS_Deterministic") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling)
+				+ (m_reuseTree ? "_r" : "") + (m_timeBudgetMs > 0 ? "_t" + std::to_string(m_timeBudgetMs) : "");
 		}
 	}
 
+	void* createPerThreadContext() const override {
+		return m_reuseTree ? static_cast<ThreadContext*>(new MCTS_ThreadContext(this)) : BaseNetworkAI::createPerThreadContext();
+	}
+
 	std::pair<sevenWD::Move, float> selectMove(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext) override;
 
 	void initRoot(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves, core::LinearAllocator& linAllocator);
 	MTCS_Node* selection(MTCS_Node* pNode, u32& depth);
 	MTCS_Node* expansion(MTCS_Node* pNode, core::LinearAllocator& linAllocator);
-	std::pair<float, u32> playout(MTCS_Node* pNode, std::vector<sevenWD::Move>& scratchMoves, void* pThreadContext);
+	std::pair<float, u32> playout(MTCS_Node* pNode, sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext);
 	void backPropagate(MTCS_Node* pNode, float reward);
 };
 
 struct MCTS_Zero : BaseNetworkAI
 {
-	std::mt19937 m_rand{ (u32)time(nullptr) };
-	thread_pool* m_threadPool = nullptr;
+	bool m_useMT = false; // run the samplings on core::Scheduler
 	u32 m_numMoves = 1000;
 	u32 m_numSampling = 50;
 	float C = 2.0f;
@@ -112,19 +307,71 @@ struct MCTS_Zero : BaseNetworkAI
 	bool m_useDirichletNoise = true;
 	bool m_useTemperature = true;
 	bool m_useBestAvgSampledScenario = true;
+	u32 m_nnBatchSize = 1; // leaves evaluated per network call, > 1 collects them under virtual loss
+	bool m_reuseTree = false; // keep the searched subtrees for the next move (needs a thread context)
+	u32 m_timeBudgetMs = 0; // > 0: wall clock budget per move, m_numMoves is then an upper bound
+	u32 m_numTreeThreads = 1; // > 1: workers of the scheduler sharing each determinization tree, the determinizations run one after the other
+	std::shared_ptr<NNEvalCache> m_nnCache; // network evaluations shared by the threads and the moves of the searches (see enableNNCache)
+	u32 m_transpositionBudgetMB = 0; // > 0: transposition table of this size per search thread (not with tree reuse, batches or the tree-parallel search)
+	bool m_useISMCTS = false; // one tree over information sets for m_numMoves * m_numSampling iterations instead of one tree per determinization
+	u32 m_gumbelNumConsidered = 0; // > 0: Gumbel root search, sequential halving over this many root moves sampled from the priors (not with the tree-parallel or ISMCTS searches)
 	static constexpr float cEpsilon = 1e-5f;
+	static constexpr u32 cMaxNNBatchSize = 64;
+	static constexpr float cGumbelVisitScale = 50.0f; // sigma(q) = (cGumbelVisitScale + max child visits) * cGumbelValueScale * q
+	static constexpr float cGumbelValueScale = 1.0f;
+
+	// Leaves collected by simulateBatch(), their inputs are grouped per age network
+	struct LeafBatch {
+		struct Leaf {
+			MTCS_Node* m_pNode;
+			u32 m_age;
+			u32 m_row;
+		};
+
+		explicit LeafBatch(u32 batchSize);
+		void clear();
+
+		core::FixedVector<Leaf, cMaxNNBatchSize> m_leaves;
+		u32 m_numRows[3] = { 0, 0, 0 };
+		NNKernels::AlignedVector m_inputs[3];  // rows of BaseNN::cMaxInputSize
+		NNKernels::AlignedVector m_outputs[3]; // rows of BaseNN::cMaxOutputSize
+	};
 
 	using BaseNetworkAI::BaseNetworkAI;
 	MCTS_Zero(u32 numMoves, u32 numGameState, bool mt = false);
 
 	void enableMT();
+	void enableNNCache(u32 sizeMB);
 
 	std::string getName() const override {
-		return std::string("MCTS_Zero") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling) + ((m_scienceBoost>0) ? "_sc" : "");
+		return std::string("MCTS_Zero") + "_m" + std::to_string(m_numMoves) + "_s" + std::to_string(m_numSampling) + ((m_scienceBoost>0) ? "_sc" : "")
+			+ ((m_nnBatchSize > 1) ? "_b" + std::to_string(m_nnBatchSize) : "") + (m_reuseTree ? "_r" : "")
+			+ (m_timeBudgetMs > 0 ? "_t" + std::to_string(m_timeBudgetMs) : "") + (useTreeParallel() ? "_tp" + std::to_string(m_numTreeThreads) : "")
+			+ (m_transpositionBudgetMB > 0 ? "_tt" + std::to_string(m_transpositionBudgetMB) : "") + (m_useISMCTS ? "_is" : "")
+			+ (useGumbel() ? "_g" + std::to_string(m_gumbelNumConsidered) : "");
+	}
+
+	void* createPerThreadContext() const override {
+		return m_reuseTree ? static_cast<ThreadContext*>(new MCTS_ThreadContext(this)) : BaseNetworkAI::createPerThreadContext();
 	}
 
+	// Tree-parallel search, trees are then neither reused nor evaluated in batches
+	// (the ISMCTS search runs on the calling thread and ignores these options)
+	bool useTreeParallel() const { return m_useMT && m_numTreeThreads > 1; }
+	// Gumbel root search, the root then gets no Dirichlet noise and the leaves are evaluated one at a time
+	bool useGumbel() const { return m_gumbelNumConsidered > 0 && !useTreeParallel() && !m_useISMCTS; }
+
 	std::pair<sevenWD::Move, float> selectMove(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext) override;
 
+	// Pondering: searches _game in the background while the opponent thinks, as a core::Scheduler task, until
+	// stopPondering() or every tree is solved or reaches MCTS_TreeCache::cMaxTreeSize. It runs by rounds of m_numMoves iterations
+	// per sampling, so every sampling grows even without MT. The trees stay in the thread context, the next selectMove()
+	// with this context then continues from the subtree of the move played. Returns false when the trees cannot be kept
+	// (no tree reuse or thread context, tree-parallel or ISMCTS search) or the game is over.
+	bool startPondering(const sevenWD::GameContext& _sevenWDContext, const sevenWD::GameController& _game, void* pThreadContext);
+	// Ends the background search and waits for it, to call before selectMove() or changing the settings of the AI
+	void stopPondering(void* pThreadContext);
+
 	void fillPUCTPriors(void* pContext, float(&puctPriors)[sevenWD::GameController::cMaxNumMoves]) override {
 		ThreadContext* pThreadContext = (ThreadContext*)pContext;
 		DEBUG_ASSERT(pThreadContext == nullptr || pThreadContext->m_pThis == this);
@@ -140,9 +387,60 @@ struct MCTS_Zero : BaseNetworkAI
 	bool needPUCTPriors() const override { return true; }
 
 	void initPUCTPriors(MTCS_Node* pNode, void* pThreadContext, const sevenWD::Move moves[], u32 numMoves) const;
+	void initPUCTPriors(const sevenWD::GameState& state, u32 curPlayer, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], float& nnHeuristic,
+		void* pThreadContext, const sevenWD::Move moves[], u32 numMoves) const;
+	void normalizePUCTPriors(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves) const;
+	void normalizePUCTPriors(const sevenWD::GameState& state, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], const sevenWD::Move moves[], u32 numMoves) const;
 	void computeNNInference(MTCS_Node* pNode, void* pThreadContext) const;
+	// Returns the win probability of curPlayer, the raw priors are written to puctPriors. Goes through m_nnCache when enabled.
+	float computeNNInference(const sevenWD::GameState& state, u32 curPlayer, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], void* pThreadContext) const;
+	u64 computeNNCacheKey(const sevenWD::GameState& state, u32 curPlayer) const;
 	void initRoot(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves, core::LinearAllocator& linAllocator, void* pThreadContext);
-	MTCS_Node* selection(MTCS_Node* pNode, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext);
-	std::pair<float, u32> playout(MTCS_Node* pNode, std::vector<sevenWD::Move>& scratchMoves, void* pThreadContext);
+	void addDirichletNoise(MTCS_Node* pNode, const sevenWD::Move moves[], u32 numMoves) const;
+	void addDirichletNoise(const sevenWD::GameContext& context, float (&puctPriors)[sevenWD::GameController::cMaxNumMoves], const sevenWD::Move moves[], u32 numMoves) const;
+	// With a batch, new leaves needing the network are returned with m_pendingNNEval set instead of being evaluated.
+	// With a transposition table, a child reached by another move order is shared and its m_pParent is the node of the
+	// last descent, so backPropagate() follows the selected path.
+	MTCS_Node* selection(MTCS_Node* pNode, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext, LeafBatch* pBatch = nullptr,
+		MCTS_TranspositionTable* pTranspositions = nullptr);
+	void expandNode(MTCS_Node* pNode, core::LinearAllocator& linAllocator, void* pThreadContext, LeafBatch* pBatch);
+	// Child picked by PUCT, a proven win for the player to move is always picked and proven losses are skipped
+	u32 selectChild(const MTCS_Node* pNode) const;
+	std::pair<float, u32> playout(MTCS_Node* pNode, sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext);
 	void backPropagate(MTCS_Node* pNode, float reward);
+
+	// Runs up to maxSimulations selections, pending leaves get a virtual loss so the next descents spread over the tree,
+	// then evaluates them with one forwardBatch per age and backpropagates. Returns the number of simulations done.
+	u32 simulateBatch(MTCS_Node* pRoot, u32 maxSimulations, u32& maxDepth, core::LinearAllocator& linAllocator, LeafBatch& batch,
+		sevenWD::GameController::MoveList& scratchMoves, void* pThreadContext);
+	static void addVirtualLoss(MTCS_Node* pNode);
+	static void removeVirtualLoss(MTCS_Node* pNode);
+
+	// Tree-parallel search: m_numTreeThreads workers of the scheduler run the simulations of one tree, the node statistics are
+	// atomic and a path gets a virtual loss during the descent. Each thread allocates its nodes from its own allocator.
+	// Returns the max depth reached.
+	u32 searchTreeParallel(MTCS_Node* pRoot, u32 numIterations, const core::Deadline& deadline,
+		std::vector<std::unique_ptr<core::LinearAllocator>>& allocators, void* pThreadContext);
+	// Returns nullptr when the path meets a node being expanded by another thread, the virtual loss is then removed
+	MTCS_Node* selectionShared(MTCS_Node* pRoot, u32& depth, core::LinearAllocator& linAllocator, void* pThreadContext);
+	void backPropagateShared(MTCS_Node* pNode, float reward);
+
+	// Gumbel root search (Danihelka et al., Policy improvement by planning with Gumbel): the root moves with the best
+	// Gumbel noise + prior logits are searched by sequential halving, their simulations then descend with PUCT.
+	// Returns the index of the selected root child.
+	u32 searchGumbel(MTCS_Node* pRoot, u32 numIterations, const core::Deadline& deadline, u32& maxDepth, core::LinearAllocator& linAllocator,
+		sevenWD::GameController::MoveList& scratchMoves, MCTS_TranspositionTable* pTranspositions, void* pThreadContext);
+	// Improved policy of the root children, softmax(logits + sigma(completed Q)). The completed Q of an unvisited child
+	// is the value of the root mixed with the Q of the visited children.
+	void computeGumbelPolicy(const MTCS_Node* pRoot, float (&completedQ)[sevenWD::GameController::cMaxMoveListSize],
+		float (&policy)[sevenWD::GameController::cMaxMoveListSize]) const;
+
+	// Single tree information set search: each iteration samples a determinization of _game and descends through the
+	// moves legal in it, PUCT uses the availability count of a move instead of the visits of its node
+	std::pair<sevenWD::Move, float> selectMoveISMCTS(const sevenWD::GameController& _game, const std::vector<sevenWD::Move>& _moves, void* pThreadContext);
+	void expandISMCTS(ISMCTS_Node* pNode, const sevenWD::GameController& game, const sevenWD::Move moves[], u32 numMoves,
+		core::LinearAllocator& linAllocator, void* pThreadContext) const;
+	// Edge picked by PUCT among the legal moves of the determinization, an immediate win for the player to move is always picked
+	ISMCTS_Node::Edge* selectEdgeISMCTS(ISMCTS_Node* pNode, const sevenWD::GameController::MoveList& moves, const sevenWD::GameContext& context,
+		core::LinearAllocator& linAllocator) const;
 };
\ No newline at end of file
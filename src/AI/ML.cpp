@@ -462,6 +462,8 @@ void ML_Toolbox::trainNet(u32 age, u32 epoch, const std::vector<Batch>& batches,
 
 		std::cout << "Loss:" << avgLoss << " | Acc: " << avgAcc<< " : " << avgAbsErr << std::endl;
 	}
+
+	pNet->prepareAfterLoad();
 }
 
 void ML_Toolbox::trainNet(u32 age, u32 epoch, tiny_dnn::tensor_t& data, tiny_dnn::tensor_t& labels, BaseNN* pNet)
@@ -499,6 +501,8 @@ void ML_Toolbox::trainNet(u32 age, u32 epoch, tiny_dnn::tensor_t& data, tiny_dnn
 		}, 
 
 		false, 16);
+
+	pNet->prepareAfterLoad();
 }
 
 #else // libtorch
@@ -675,13 +679,94 @@ bool ML_Toolbox::loadLastGenNet(NetworkType netType, std::string namePrefix, boo
 	return true;
 }
 
-tiny_dnn::vec_t BaseNN::forward(const tiny_dnn::vec_t& x, void* pThreadContext, u32 netAge)
+#ifdef USE_TINY_DNN
+void BaseNN::fillInput(const sevenWD::GameState& _state, u32 _player, float* _input) const
 {
-	BaseNetworkAI::ThreadContext* pCtx = reinterpret_cast<BaseNetworkAI::ThreadContext*>(pThreadContext);
-	if (pCtx) {
-		return pCtx->m_net[netAge].predict(x);
+	_state.fillTensorData(_input, _player);
+	if (m_extraTensorData)
+		_state.fillExtraTensorData(_input + sevenWD::GameState::TensorSize);
+
+	// the padding read by the SIMD kernels is multiplied by zero weights, it only has to be finite
+	std::fill(_input + getInputSize(), _input + cMaxInputSize, 0.0f);
+}
+
+void BaseNN::forward(Buffers& _buffers) const
+{
+	const u32 inputSize = getInputSize();
+	tiny_dnn::vec_t x(_buffers.m_input, _buffers.m_input + inputSize);
+
+	std::lock_guard<std::mutex> lock(m_predictMutex);
+	const tiny_dnn::vec_t y = const_cast<TinyDNN_Net&>(m_net).predict(x);
+	DEBUG_ASSERT(y.size() <= cMaxOutputSize);
+	std::copy(y.begin(), y.end(), _buffers.m_output);
+}
+
+void BaseNN::forwardBatch(const float* _inputs, float* _outputs, u32 _count) const
+{
+	Buffers buffers;
+	for (u32 r = 0; r < _count; ++r) {
+		std::copy(_inputs + r * cMaxInputSize, _inputs + (r + 1) * cMaxInputSize, buffers.m_input);
+		forward(buffers);
+		std::copy(buffers.m_output, buffers.m_output + cMaxOutputSize, _outputs + r * cMaxOutputSize);
 	}
-	else {
-		return m_net.predict(x);
+}
+#endif
+
+void BaseNetworkAI::computeScores(const sevenWD::GameState* const states[], u32 numStates, u32 maxPlayer, float scores[], void* pContext) const
+{
+	ThreadContext* pThreadContext = (ThreadContext*)pContext;
+	DEBUG_ASSERT(pThreadContext == nullptr || pThreadContext->m_pThis == this);
+
+	// the rows of an age are gathered in the order of the states, a node's leaves rarely span two ages
+	thread_local std::vector<u32> t_rowStates;
+	t_rowStates.resize(numStates);
+
+#if defined(USE_TINY_DNN)
+	thread_local NNKernels::AlignedVector t_inputs;
+	thread_local NNKernels::AlignedVector t_outputs;
+	t_inputs.resize(size_t(numStates) * BaseNN::cMaxInputSize);
+	t_outputs.resize(size_t(numStates) * BaseNN::cMaxOutputSize);
+#endif
+
+	for (u32 age = 0; age < 3; ++age) {
+		u32 numRows = 0;
+		for (u32 i = 0; i < numStates; ++i) {
+			u8 stateAge = (u8)states[i]->getCurrentAge();
+			stateAge = stateAge == u8(-1) ? 0 : stateAge;
+			if (stateAge == age) {
+				t_rowStates[numRows++] = i;
+			}
+		}
+		if (numRows == 0) {
+			continue;
+		}
+
+		auto& network = m_network[age];
+#if defined(USE_TINY_DNN)
+		for (u32 r = 0; r < numRows; ++r) {
+			network->fillInput(*states[t_rowStates[r]], 0, t_inputs.data() + size_t(r) * BaseNN::cMaxInputSize);
+		}
+		network->forwardBatch(t_inputs.data(), t_outputs.data(), numRows);
+
+		for (u32 r = 0; r < numRows; ++r) {
+			const float player0WinProbability = t_outputs[size_t(r) * BaseNN::cMaxOutputSize];
+			scores[t_rowStates[r]] = maxPlayer == 0 ? player0WinProbability : 1.0f - player0WinProbability;
+		}
+#else
+		const u32 tensorSize = sevenWD::GameState::TensorSize + (network->m_extraTensorData ? sevenWD::GameState::ExtraTensorSize : 0);
+		std::vector<float> buffer(size_t(numRows) * tensorSize);
+		for (u32 r = 0; r < numRows; ++r) {
+			float* row = buffer.data() + size_t(r) * tensorSize;
+			states[t_rowStates[r]]->fillTensorData(row, 0);
+			if (network->m_extraTensorData)
+				states[t_rowStates[r]]->fillExtraTensorData(row + sevenWD::GameState::TensorSize);
+		}
+
+		torch::Tensor result = network->forward(torch::from_blob(buffer.data(), { numRows, tensorSize }, torch::kFloat));
+		for (u32 r = 0; r < numRows; ++r) {
+			const float player0WinProbability = result[r].item<float>();
+			scores[t_rowStates[r]] = maxPlayer == 0 ? player0WinProbability : 1.0f - player0WinProbability;
+		}
+#endif
 	}
-}
\ No newline at end of file
+}
@@ -4,7 +4,9 @@
 #include "7WDuel/GameController.h"
 #include "AI.h"
 #include "MinMaxAI.h"
+#include "NNKernels.h"
 #include <mutex>
+#include <atomic>
 #include <array>
 
 enum class NetworkType {
@@ -47,14 +49,45 @@ struct BaseNN
 	using TinyDNN_Net = tiny_dnn::network<tiny_dnn::sequential>;
 	tiny_dnn::network<tiny_dnn::sequential> m_net;
 
-	virtual void prepareAfterLoad() {}
-	virtual tiny_dnn::vec_t forward(const tiny_dnn::vec_t& x, void* pThreadContext, u32 netAge);
+	static constexpr u32 cMaxInputSize = NNKernels::paddedSize(sevenWD::GameState::TensorSize + sevenWD::GameState::ExtraTensorSize);
+	static constexpr u32 cMaxOutputSize = NNKernels::paddedSize(1 + sevenWD::GameController::cMaxNumMoves);
+
+	// Input and output of forward(), lives on the caller stack so inference never allocates
+	struct Buffers {
+		alignas(NNKernels::cAlignment) float m_input[cMaxInputSize];
+		alignas(NNKernels::cAlignment) float m_output[cMaxOutputSize];
+	};
+
+	// Must be called once the weights are final (after loading or training): the networks copy them
+	// into the read-only layout used by forward(). Overrides call the base version, which starts a new generation.
+	virtual void prepareAfterLoad() { m_generation = s_numGenerations.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+	// Identifies the current weights, unique among all the networks: results cached for another generation are stale
+	u32 getGeneration() const { return m_generation; }
+
+	// Thread-safe inference, the weights are shared by all threads and never modified.
+	// Networks without a packed forward pass fall back to tiny-dnn, serialized by m_predictMutex.
+	virtual void forward(Buffers& _buffers) const;
+
+	// forward() over _count rows: _inputs holds rows of cMaxInputSize floats (filled like Buffers::m_input) and
+	// _outputs receives rows of cMaxOutputSize floats. Both must be 32 bytes aligned.
+	virtual void forwardBatch(const float* _inputs, float* _outputs, u32 _count) const;
 	TinyDNN_Net& getNetwork() { return m_net; }
+
+	u32 getInputSize() const { return sevenWD::GameState::TensorSize + (m_extraTensorData ? sevenWD::GameState::ExtraTensorSize : 0); }
+	void fillInput(const sevenWD::GameState& _state, u32 _player, Buffers& _buffers) const { fillInput(_state, _player, _buffers.m_input); }
+	void fillInput(const sevenWD::GameState& _state, u32 _player, float* _input) const;
+
+	mutable std::mutex m_predictMutex; // m_net.predict() uses internal buffers
 #else
 	virtual torch::Tensor forward(torch::Tensor) { DEBUG_ASSERT(0); }
 #endif
 	
 	const char* getNetName() const { return getNetworkName(m_netType); }
+
+private:
+	inline static std::atomic<u32> s_numGenerations = 0;
+	u32 m_generation = 0;
 };
 
 struct BaseNetworkAI : sevenWD::AIInterface, sevenWD::MinMaxAIHeuristic {
@@ -63,8 +96,10 @@ struct BaseNetworkAI : sevenWD::AIInterface, sevenWD::MinMaxAIHeuristic {
 	}
 
 	struct ThreadContext {
+		explicit ThreadContext(const BaseNetworkAI* pThis) : m_pThis(pThis) {}
+		virtual ~ThreadContext() = default;
+
 		const BaseNetworkAI* m_pThis;
-		BaseNN::TinyDNN_Net m_net[3];
 		float m_puctPriors[sevenWD::GameController::cMaxNumMoves] = { 0.f }; // Priors for PUCT search (used to train a NN-based MCTS AI)
 	};
 
@@ -73,49 +108,35 @@ struct BaseNetworkAI : sevenWD::AIInterface, sevenWD::MinMaxAIHeuristic {
 		age = age == u8(-1) ? 0 : age;
 		auto& network = m_network[age];
 
-		const u32 tensorSize = sevenWD::GameState::TensorSize + (network->m_extraTensorData ? sevenWD::GameState::ExtraTensorSize : 0);
-
 #if defined(USE_TINY_DNN)
-		tiny_dnn::vec_t buffer(tensorSize);
+		ThreadContext* pThreadContext  = (ThreadContext*)pContext;
+		DEBUG_ASSERT(pThreadContext == nullptr || pThreadContext->m_pThis == this);
+
+		BaseNN::Buffers buffers;
+		network->fillInput(state, 0, buffers);
+		network->forward(buffers);
+		float player0WinProbability = buffers.m_output[0];
 #else
+		const u32 tensorSize = sevenWD::GameState::TensorSize + (network->m_extraTensorData ? sevenWD::GameState::ExtraTensorSize : 0);
 		std::vector<float> buffer(tensorSize);
-#endif
 		state.fillTensorData(buffer.data(), 0);
 		if (network->m_extraTensorData)
 			state.fillExtraTensorData(buffer.data() + sevenWD::GameState::TensorSize);
 
-#if defined(USE_TINY_DNN)
-		ThreadContext* pThreadContext  = (ThreadContext*)pContext;
-		DEBUG_ASSERT(pThreadContext == nullptr || pThreadContext->m_pThis == this);
-		tiny_dnn::vec_t output = network->forward(buffer, pThreadContext, age);
-		float player0WinProbability = output[0];
-#else
 		torch::Tensor result = network->forward(torch::from_blob(buffer.data(), { 1, tensorSize }, torch::kFloat));
 		float player0WinProbability = result[0].item<float>();
 #endif
 		return maxPlayer == 0 ? player0WinProbability : 1.0f - player0WinProbability;
 	}
 
-	void* createPerThreadContext() const override {
-		static std::mutex m_mutex;
-		
-
-		if (m_network[0] && m_network[1] && m_network[2]) {
-			ThreadContext* pContext = new ThreadContext{ this };
-			m_mutex.lock();
-			m_network[0]->getNetwork().save("tmp0_createPerThreadContext.bin");
-			m_network[1]->getNetwork().save("tmp1_createPerThreadContext.bin");
-			m_network[2]->getNetwork().save("tmp2_createPerThreadContext.bin");
-			pContext->m_net[0].load("tmp0_createPerThreadContext.bin");
-			pContext->m_net[1].load("tmp1_createPerThreadContext.bin");
-			pContext->m_net[2].load("tmp2_createPerThreadContext.bin");
-			m_mutex.unlock();
-			return pContext;
-		}
-		else if (needPUCTPriors()) {
-			ThreadContext* pContext = new ThreadContext{ this };
-			return pContext;
+	// One batched forward per age network instead of one forward per state
+	void computeScores(const sevenWD::GameState* const states[], u32 numStates, u32 maxPlayer, float scores[], void* pContext) const override;
+	bool prefersBatchedScores() const override { return true; }
 
+	// The networks are shared by all threads (BaseNN::forward is thread-safe), a context only holds per-thread results
+	void* createPerThreadContext() const override {
+		if ((m_network[0] && m_network[1] && m_network[2]) || needPUCTPriors()) {
+			return new ThreadContext(this);
 		}
 		else {
 			return nullptr;
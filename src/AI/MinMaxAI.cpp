@@ -1,132 +1,366 @@
 #include "AI/MinMaxAI.h"
-#include <future>
 
-#include "Core/thread_pool.h"
+#include "Core/Scheduler.h"
 
 namespace sevenWD
 {
-#ifdef _DEBUG
-    thread_pool s_threadPool(1);
-#else
-    thread_pool s_threadPool;
-#endif
-
     MinMaxAI::MinMaxAI(const MinMaxAIHeuristic* pHeuristic, u32 _maxDepth, bool _monothread) : m_pHeuristic(pHeuristic), m_maxDepth{ _maxDepth }, m_monothread{ _monothread }
     {
 
     }
 
-    std::pair<Move, float> MinMaxAI::selectMove(const GameContext&, const GameController& _game, const std::vector<Move>& _moves, void* pThreadContext)
+    static u32 packMove(const Move& _move)
+    {
+        static_assert(sizeof(Move) == sizeof(u32));
+        u32 packed;
+        memcpy(&packed, &_move, sizeof(packed));
+        return packed;
+    }
+
+    // 1 when _maxPlayer won the finished game, 0 otherwise
+    static float computeEndScore(const GameController& _gameState, u32 _maxPlayer)
+    {
+        if (_maxPlayer == 0 && _gameState.m_gameState.m_state == GameState::State::WinPlayer0)
+            return 1.0f;
+        if (_maxPlayer == 1 && _gameState.m_gameState.m_state == GameState::State::WinPlayer1)
+            return 1.0f;
+        return 0.0f;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    MinMaxAI::TranspositionTable::TranspositionTable(size_t _memoryBudget) : m_memoryBudget(_memoryBudget)
+    {
+        // power of two number of slots so the slot is a mask of the hash
+        size_t numSlots = 1;
+        while (numSlots * 2 * sizeof(Slot) <= _memoryBudget)
+            numSlots *= 2;
+        m_slots = std::make_unique<Slot[]>(numSlots);
+        m_indexMask = numSlots - 1;
+    }
+
+    MinMaxAI::TranspositionTable& MinMaxAI::TranspositionTable::acquire(size_t _memoryBudget)
     {
-        std::vector<std::future<float>> asyncScores(_moves.size());
-        std::atomic<float> b = 1.0f;
+        // clearing the table would cost more than a small search
+        thread_local std::unique_ptr<TranspositionTable> t_pTable;
+        if (!t_pTable || t_pTable->m_memoryBudget != _memoryBudget)
+            t_pTable = std::make_unique<TranspositionTable>(_memoryBudget);
+
+        t_pTable->m_salt = ++t_pTable->m_numSearches * 0x9E3779B97F4A7C15ull;
+        return *t_pTable;
+    }
+
+    bool MinMaxAI::TranspositionTable::find(u64 _hash, Entry& _entry) const
+    {
+        const u64 key = _hash ^ m_salt;
+        const Slot& slot = m_slots[key & m_indexMask];
+        const u64 data = slot.m_data.load(std::memory_order_relaxed);
+        if (data == 0 || (slot.m_keyXorData.load(std::memory_order_relaxed) ^ data) != key)
+            return false;
+
+        const u32 scoreBits = u32(data);
+        memcpy(&_entry.m_score, &scoreBits, sizeof(float));
+        _entry.m_depth = u8(data >> 32);
+        _entry.m_bound = Bound(u8(data >> 40));
+        _entry.m_bestMove = u8(data >> 48);
+        return true;
+    }
+
+    void MinMaxAI::TranspositionTable::store(u64 _hash, const Entry& _entry)
+    {
+        const u64 key = _hash ^ m_salt;
+        Slot& slot = m_slots[key & m_indexMask];
+
+        // a deeper result of the same position is kept, any other position is replaced
+        const u64 oldData = slot.m_data.load(std::memory_order_relaxed);
+        if (oldData != 0 && (slot.m_keyXorData.load(std::memory_order_relaxed) ^ oldData) == key && u8(oldData >> 32) > _entry.m_depth)
+            return;
+
+        u32 scoreBits;
+        memcpy(&scoreBits, &_entry.m_score, sizeof(float));
+        const u64 data = u64(scoreBits) | (u64(_entry.m_depth) << 32) | (u64(_entry.m_bound) << 40) | (u64(_entry.m_bestMove) << 48) | (u64(1) << 56);
+        slot.m_keyXorData.store(key ^ data, std::memory_order_relaxed);
+        slot.m_data.store(data, std::memory_order_relaxed);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    std::pair<Move, float> MinMaxAI::selectMove(const GameContext& _sevenWDContext, const GameController& _game, const std::vector<Move>& _moves, void* pThreadContext)
+    {
+        // the first depth has no inner node to store
+        const core::Deadline deadline(m_timeBudgetMs);
+        TranspositionTable* pTranspositions = m_maxDepth > 1 && m_transpositionBudgetMB > 0 ? &TranspositionTable::acquire(size_t(m_transpositionBudgetMB) * 1024 * 1024) : nullptr;
+
+        // Lazy SMP: the helpers only share the table with this search and stop with it. Without a table they would
+        // only repeat it.
+        std::atomic<bool> stopHelpers = false;
+        const core::Deadline helperDeadline = deadline.withStopFlag(&stopHelpers);
+        // on busy workers (a tournament), the helpers only start once this search is done and return at once
+        const u32 numHelpers = m_monothread || pTranspositions == nullptr ? 0 : core::Scheduler::get().getNumWorkers() - 1;
+        // the helpers reveal cards from their own random stream, the stream of the game is only used by this search
+        const u64 helperStream = numHelpers > 0 ? _sevenWDContext.rand()() : 0;
+        std::vector<SearchStats> helperStats(numHelpers);
+        core::TaskGroup helpers;
+        for (u32 i = 0; i < numHelpers; ++i)
+            helpers.run([&, i]() { runHelper(i, _game, _moves, helperDeadline, pTranspositions, helperStream + i, helperStats[i], pThreadContext); });
+
+        // Iterative deepening: a depth starts with the best moves of the previous one, at the root and through the
+        // transposition table. The first depth only evaluates the children and always completes.
+        SearchState search(deadline, pTranspositions);
+        std::vector<Move> rootMoves = _moves;
+        std::pair<Move, float> bestMove;
 
-        auto evalPosLambda = [&](const Move& _move)
+        for (u32 depth = 1; depth <= m_maxDepth; ++depth)
         {
-            GameController newGameState = _game;
+            search.m_maxDepth = depth;
+            std::pair<Move, float> move = searchRoot(_game, rootMoves, search, pThreadContext);
+            if (search.m_stopAI)
+                break; // interrupted, the scores of this depth are incomplete
+            bestMove = move;
+            if (search.m_deadline.hasExpired())
+                break;
+        }
 
-            u32 curPlayer = _game.m_gameState.getCurrentPlayerTurn();
-            float score;
-            if (newGameState.play(_move))
-            {
-                if (curPlayer == 0 && newGameState.m_gameState.m_state == GameState::State::WinPlayer0)
-                    score = 1.0f;
-                else if (curPlayer == 1 && newGameState.m_gameState.m_state == GameState::State::WinPlayer1)
-                    score = 1.0f;
-                else
-                    score = 0.0f;
-            }
+        stopHelpers = true;
+        helpers.wait();
+
+        // the shared counters are only touched here, the threads of the searches count on their own
+        SearchStats stats = search.m_stats;
+        for (const SearchStats& helper : helperStats)
+        {
+            stats.m_numNodes += helper.m_numNodes;
+            stats.m_numMoves += helper.m_numMoves;
+            stats.m_numLeaves += helper.m_numLeaves;
+        }
+        m_numNodeExplored += stats.m_numNodes;
+        m_numMoves += stats.m_numMoves;
+        n_numLeafEpxlored += stats.m_numLeaves;
+        return bestMove;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    void MinMaxAI::runHelper(u32 _helperIndex, const GameController& _game, const std::vector<Move>& _moves, const core::Deadline& _deadline,
+        TranspositionTable* _pTranspositions, u64 _randStream, SearchStats& _stats, void* pThreadContext)
+    {
+        const ScopedRandStream randStream(*_game.m_gameState.m_context, _randStream);
+        SearchState search(_deadline, _pTranspositions);
+        std::vector<Move> rootMoves = _moves;
+        std::rotate(rootMoves.begin(), rootMoves.begin() + (_helperIndex + 1) % rootMoves.size(), rootMoves.end());
+
+        // a helper starting after the main search is done stops at once
+        for (u32 depth = 2 + (_helperIndex % 2); depth <= m_maxDepth && !search.m_stopAI && !_deadline.hasExpired(); ++depth)
+        {
+            search.m_maxDepth = depth;
+            searchRoot(_game, rootMoves, search, pThreadContext);
+        }
+        _stats = search.m_stats;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    std::pair<Move, float> MinMaxAI::searchRoot(const GameController& _game, std::vector<Move>& _moves, SearchState& _search, void* pThreadContext)
+    {
+        const u32 curPlayer = _game.m_gameState.getCurrentPlayerTurn();
+        std::vector<float> scores(_moves.size(), 0.0f);
+        float a = 0.0f;
+
+        GameController game = _game;
+        GameController::UndoRecord undoRecord;
+        for (u32 i = 0; i < _moves.size() && !_search.m_stopAI; ++i)
+        {
+            if (game.play(_moves[i], undoRecord))
+                scores[i] = computeEndScore(game, curPlayer);
             else
-                score = evalRec(curPlayer, newGameState, 1, { 0.0f, b }, pThreadContext);
+                scores[i] = evalRec(curPlayer, game, 1, { a, 1.0f }, _search, pThreadContext);
+            game.undo(undoRecord);
 
-            b.store(std::min(b.load(), score));
-            return score;
-        };
+            a = std::max(a, scores[i]);
+        }
 
-        std::transform(_moves.begin(), _moves.end(), asyncScores.begin(),
-            [&](const Move& move) -> std::future<float>
-            {
-                if (m_monothread)
-                {
-                    std::promise<float> scorePromise;
-                    scorePromise.set_value(evalPosLambda(move));
-                    return scorePromise.get_future();
-                }
-                else
-                    return s_threadPool.submit([&]() -> float { return evalPosLambda(move); });
-            });
+        // a move failing low only has an upper bound, good enough to order the next depth
+        std::vector<u32> order(_moves.size());
+        for (u32 i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](u32 i, u32 j) { return scores[i] > scores[j]; });
 
-        std::vector<float> scores(asyncScores.size());
-        std::transform(asyncScores.begin(), asyncScores.end(), scores.begin(),
-            [&](std::future<float>& _score)
-            {
-                return _score.get();
-            });
+        std::vector<Move> sortedMoves(_moves.size());
+        for (u32 i = 0; i < order.size(); ++i)
+            sortedMoves[i] = _moves[order[i]];
+        _moves = std::move(sortedMoves);
 
-        auto bestIt = std::max_element(scores.begin(), scores.end());
-        u32 bestScoreIndex = (u32)std::distance(scores.begin(), bestIt);
-        return { _moves[bestScoreIndex], scores[bestScoreIndex] };
+        return { _moves[0], scores[order[0]] };
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    void MinMaxAI::orderMoves(const GameController& _gameState, const GameController::MoveList& _moves, u32 _ttMove, u32 _depth, const SearchState& _search,
+        u8 (&_order)[GameController::cMaxMoveListSize]) const
+    {
+        const GameContext& context = *_gameState.m_gameState.m_context;
+        const u32 player = _gameState.m_gameState.getCurrentPlayerTurn();
+        const u32 killers[2] = { _depth < cMaxPly ? _search.m_killers[_depth][0] : 0, _depth < cMaxPly ? _search.m_killers[_depth][1] : 0 };
+
+        // the history counts stay below 2^32, the tt move and the killers go first
+        u64 keys[GameController::cMaxMoveListSize];
+        for (u32 i = 0; i < _moves.size(); ++i)
+        {
+            const u32 packed = packMove(_moves[i]);
+            if (i == _ttMove)
+                keys[i] = u64(3) << 32;
+            else if (packed == killers[0])
+                keys[i] = u64(2) << 32;
+            else if (packed == killers[1])
+                keys[i] = u64(1) << 32;
+            else
+                keys[i] = _search.m_history[player][_moves[i].computeMoveFixedIndex(context)];
+        }
+
+        // few moves, insertion sort keeps equal keys in enumerateMoves() order
+        for (u32 i = 0; i < _moves.size(); ++i)
+        {
+            u32 j = i;
+            for (; j > 0 && keys[_order[j - 1]] < keys[i]; --j)
+                _order[j] = _order[j - 1];
+            _order[j] = u8(i);
+        }
+    }
+
+    void MinMaxAI::recordCutoff(const GameController& _gameState, const Move& _move, u32 _depth, SearchState& _search) const
+    {
+        const u32 packed = packMove(_move);
+        if (_depth < cMaxPly && _search.m_killers[_depth][0] != packed)
+        {
+            _search.m_killers[_depth][1] = _search.m_killers[_depth][0];
+            _search.m_killers[_depth][0] = packed;
+        }
+
+        const u32 depthLeft = _search.m_maxDepth - _depth;
+        const u32 player = _gameState.m_gameState.getCurrentPlayerTurn();
+        u32& history = _search.m_history[player][_move.computeMoveFixedIndex(*_gameState.m_gameState.m_context)];
+        if (history < (1u << 31))
+            history += depthLeft * depthLeft;
     }
 
 	//-------------------------------------------------------------------------------------------------
-	float MinMaxAI::evalRec(u32 _maxPlayer, const GameController& _gameState, u32 _depth, vec2 _a_b, void* pThreadContext)
+	float MinMaxAI::evalRec(u32 _maxPlayer, GameController& _gameState, u32 _depth, vec2 _a_b, SearchState& _search, void* pThreadContext)
 	{
-        bool isMaxPlayerTurn = _gameState.m_gameState.getCurrentPlayerTurn() == _maxPlayer;
-
-        if (_depth >= m_maxDepth || m_stopAI)
+        if (_depth >= _search.m_maxDepth || _search.m_stopAI)
         {
-            n_numLeafEpxlored++;
+            _search.m_stats.m_numLeaves++;
             return m_pHeuristic->computeScore(_gameState.m_gameState, _maxPlayer, nullptr);
         }
 
-        std::vector<Move> moves;
+        const u32 depthLeft = _search.m_maxDepth - _depth;
+        const u64 hash = _gameState.m_gameState.getHash();
+        const vec2 window = _a_b;
+
+        // a result searched at least as deep settles the position when exact or when its bound falls outside the window
+        TranspositionTable::Entry entry;
+        u32 ttMove = u32(-1);
+        if (_search.m_pTranspositions && _search.m_pTranspositions->find(hash, entry))
+        {
+            ttMove = entry.m_bestMove;
+            if (entry.m_depth >= depthLeft)
+            {
+                if (entry.m_bound == Bound::Exact
+                    || (entry.m_bound == Bound::Lower && entry.m_score >= _a_b.y)
+                    || (entry.m_bound == Bound::Upper && entry.m_score <= _a_b.x))
+                    return entry.m_score;
+            }
+        }
+
+        GameController::MoveList moves;
         _gameState.enumerateMoves(moves);
 
-        m_numMoves += moves.size();
-        m_numNodeExplored++;
+        _search.m_stats.m_numMoves += moves.size();
+
+        // the clock is only read every few nodes of this thread
+        if ((_search.m_stats.m_numNodes++ % 256) == 0 && _search.m_deadline.hasExpired())
+            _search.m_stopAI = true;
+
+        u8 order[GameController::cMaxMoveListSize];
+        orderMoves(_gameState, moves, ttMove, _depth, _search, order);
+
+        // maxPlayer maximizes its score, the opponent minimizes it
+        const bool isMaxPlayerTurn = _gameState.m_gameState.getCurrentPlayerTurn() == _maxPlayer;
+        float score = isMaxPlayerTurn ? 0.0f : 1.0f;
+        u32 bestMove = order[0];
 
-        // The "maxPlayer" supposes the opponent minimize his score, reverse for the "minPlayer"
-        float score = isMaxPlayerTurn ? 1.0f : 0.0f;
+        // Children are explored in place, the state is restored with undo() after each move
+        GameController::UndoRecord undoRecord;
 
-        auto minmax = [isMaxPlayerTurn](float s1, float s2)
+        // The children are the leaves: all scored by one heuristic call, the cutoffs below then skip the rest
+        const bool batchLeaves = depthLeft == 1 && !_search.m_stopAI && m_pHeuristic->prefersBatchedScores();
+        if (batchLeaves)
         {
-            return isMaxPlayerTurn ? std::min(s1, s2) : std::max(s1, s2);
-        };
+            _search.m_leafStates.clear();
+            _search.m_leafScores.resize(moves.size());
+            for (u32 k = 0; k < moves.size(); ++k)
+            {
+                const u32 i = order[k];
+                if (_gameState.play(moves[i], undoRecord))
+                    _search.m_leafScores[k] = computeEndScore(_gameState, _maxPlayer);
+                else
+                {
+                    _search.m_leafScores[k] = -1.0f; // scored by the batch
+                    _search.m_leafStates.push_back(_gameState.m_gameState);
+                }
+                _gameState.undo(undoRecord);
+            }
+
+            // pointers taken once the vector has stopped growing
+            _search.m_pLeafStates.resize(_search.m_leafStates.size());
+            for (u32 j = 0; j < _search.m_leafStates.size(); ++j)
+                _search.m_pLeafStates[j] = &_search.m_leafStates[j];
+
+            _search.m_batchScores.resize(_search.m_leafStates.size());
+            m_pHeuristic->computeScores(_search.m_pLeafStates.data(), (u32)_search.m_pLeafStates.size(), _maxPlayer, _search.m_batchScores.data(), nullptr);
+            _search.m_stats.m_numLeaves += _search.m_leafStates.size();
 
-        for (size_t i = 0; i < moves.size(); ++i)
+            for (u32 k = 0, j = 0; k < moves.size(); ++k)
+            {
+                if (_search.m_leafScores[k] < 0.0f)
+                    _search.m_leafScores[k] = _search.m_batchScores[j++];
+            }
+        }
+
+        for (u32 k = 0; k < moves.size(); ++k)
         {
-            GameController newGameState = _gameState;
-            bool gameTerminated = newGameState.play(moves[i]);
+            const u32 i = order[k];
 
             float moveScore;
-            if (gameTerminated)
+            if (batchLeaves)
+                moveScore = _search.m_leafScores[k];
+            else
             {
-                if (_maxPlayer == 0 && newGameState.m_gameState.m_state == GameState::State::WinPlayer0)
-                    moveScore = 1.0f;
-                else if(_maxPlayer == 1 && newGameState.m_gameState.m_state == GameState::State::WinPlayer1)
-                    moveScore = 1.0f;
+                bool gameTerminated = _gameState.play(moves[i], undoRecord);
+                if (gameTerminated)
+                    moveScore = computeEndScore(_gameState, _maxPlayer);
                 else
-                    moveScore = 0.0f;
-            }
-            else
-                moveScore = evalRec(_maxPlayer, newGameState, _depth + 1, _a_b, pThreadContext);
+                    moveScore = evalRec(_maxPlayer, _gameState, _depth + 1, _a_b, _search, pThreadContext);
 
-            score = minmax(moveScore, score);
+                _gameState.undo(undoRecord);
+            }
 
-            if (isMaxPlayerTurn)
+            if (isMaxPlayerTurn ? moveScore > score : moveScore < score)
             {
-                if (score <= _a_b.x)
-                    return score;
-                _a_b.y = std::min(_a_b.y, score);
+                score = moveScore;
+                bestMove = i;
             }
-            else
+
+            if (isMaxPlayerTurn ? score >= _a_b.y : score <= _a_b.x)
             {
-                if (score >= _a_b.y)
-                    return score;
-                _a_b.x = std::max(_a_b.x, score);
+                recordCutoff(_gameState, moves[i], _depth, _search);
+                break;
             }
+            if (isMaxPlayerTurn)
+                _a_b.x = std::max(_a_b.x, score);
+            else
+                _a_b.y = std::min(_a_b.y, score);
         }
 
+        // scores of an interrupted search are only heuristic
+        if (_search.m_pTranspositions && !_search.m_stopAI)
+        {
+            const Bound bound = score <= window.x ? Bound::Upper : (score >= window.y ? Bound::Lower : Bound::Exact);
+            _search.m_pTranspositions->store(hash, { score, u8(depthLeft), bound, u8(bestMove) });
+        }
         return score;
 	}
 
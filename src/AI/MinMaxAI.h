@@ -1,13 +1,27 @@
 #pragma once
 
 #include "7WDuel/GameController.h"
+#include "Core/Deadline.h"
 #include "AI.h"
 
+#include <atomic>
+#include <memory>
+
 namespace sevenWD
 {
 	//-------------------------------------------------------------------------------------------------
 	struct MinMaxAIHeuristic {
 		virtual float computeScore(const GameState& _gameState, u32 _maxPlayer, void* pThreadContext) const = 0;
+
+		// Scores of _numStates states at once, by default one computeScore() per state
+		virtual void computeScores(const GameState* const _states[], u32 _numStates, u32 _maxPlayer, float _scores[], void* pThreadContext) const {
+			for (u32 i = 0; i < _numStates; ++i)
+				_scores[i] = computeScore(*_states[i], _maxPlayer, pThreadContext);
+		}
+
+		// True when computeScores() is cheaper than the separate calls, the search then scores all the leaves of a node
+		// at once, even those an alpha-beta cutoff would have skipped
+		virtual bool prefersBatchedScores() const { return false; }
 	};
 
 	//-------------------------------------------------------------------------------------------------
@@ -19,21 +33,110 @@ namespace sevenWD
 
 		double getAvgMovesPerTurn() const { return double(m_numMoves.load()) / m_numNodeExplored.load(); }
 
+		// > 0: the iterative deepening stops once the budget is spent, the best move of the last completed depth is played
+		void setTimeBudget(u32 _budgetMs) { m_timeBudgetMs = _budgetMs; }
+		// Size of the transposition table of a search, 0 disables it
+		void setTranspositionBudget(u32 _sizeMB) { m_transpositionBudgetMB = _sizeMB; }
+
 		std::pair<Move, float> selectMove(const GameContext& _sevenWDContext, const GameController& _game, const std::vector<Move>& _moves, void* pThreadContext) override;
 
 		std::string getName() const {
-			return "MinMax";
+			return m_timeBudgetMs > 0 ? "MinMax_t" + std::to_string(m_timeBudgetMs) : "MinMax";
 		}
 
 	private:
-		float evalRec(u32 _maxPlayer, const GameController& _gameState, u32 _depth, vec2 _a_b, void* pThreadContext);
+		static constexpr u32 cMaxPly = 64; // killer moves are kept up to this depth
+
+		// Kind of score stored: exact, or a bound when the search of the position failed low (upper) or high (lower)
+		enum class Bound : u8 { Exact, Lower, Upper };
+
+		// Positions searched by one selectMove, shared by the threads of the search and kept from one depth to the next.
+		// A slot is two words and the key is stored xor the data, a slot torn by concurrent writes fails the key check.
+		class TranspositionTable
+		{
+		public:
+			struct Entry
+			{
+				float m_score;
+				u8 m_depth; // plies searched below the position
+				Bound m_bound;
+				u8 m_bestMove; // index in the enumerateMoves() order of the position
+			};
+
+			explicit TranspositionTable(size_t _memoryBudget);
+
+			// Table of the calling thread, reused by its searches without clearing: the keys of each search are salted
+			static TranspositionTable& acquire(size_t _memoryBudget);
+
+			bool find(u64 _hash, Entry& _entry) const;
+			void store(u64 _hash, const Entry& _entry);
+
+		private:
+			struct Slot
+			{
+				std::atomic<u64> m_keyXorData = 0;
+				std::atomic<u64> m_data = 0; // 0 for an empty slot
+			};
+
+			std::unique_ptr<Slot[]> m_slots;
+			u64 m_indexMask = 0;
+			size_t m_memoryBudget = 0;
+			u64 m_numSearches = 0;
+			u64 m_salt = 0;
+		};
+
+		// Work counted by one search thread, added to the AI totals once the search is done
+		struct SearchStats
+		{
+			u64 m_numNodes = 0;
+			u64 m_numMoves = 0;
+			u64 m_numLeaves = 0;
+		};
+
+		// State of one search thread, selectMove can be called concurrently by several games. The threads of a search
+		// only share the transposition table.
+		struct SearchState
+		{
+			SearchState(const core::Deadline& _deadline, TranspositionTable* _pTranspositions) : m_deadline(_deadline), m_pTranspositions(_pTranspositions) {}
+
+			u32 m_maxDepth = 1; // depth of the current iteration
+			core::Deadline m_deadline;
+			std::atomic<bool> m_stopAI = false; // set once the deadline has passed, the search unwinds with heuristic scores
+			TranspositionTable* m_pTranspositions = nullptr;
+			SearchStats m_stats; // m_numNodes also paces the deadline checks
+
+			// Move ordering: the last two moves causing a cutoff at each ply, and the cutoffs of each move of each player
+			// weighted by the depth left
+			u32 m_killers[cMaxPly][2] = {};
+			u32 m_history[2][GameController::cMaxNumMoves] = {};
+
+			// leaves of the node being scored in a batch, the scores follow the search order of the moves
+			std::vector<GameState> m_leafStates;
+			std::vector<const GameState*> m_pLeafStates;
+			std::vector<float> m_batchScores;
+			std::vector<float> m_leafScores;
+		};
+
+		// Lazy SMP helper: the same iterative deepening on a thread of the pool, it fills the shared transposition table
+		// for the main search. Odd helpers run one ply deeper and each helper starts with other root moves.
+		void runHelper(u32 _helperIndex, const GameController& _game, const std::vector<Move>& _moves, const core::Deadline& _deadline,
+			TranspositionTable* _pTranspositions, u64 _randStream, SearchStats& _stats, void* pThreadContext);
+
+		// Alpha-beta over the root moves, _moves are left sorted best first for the next depth
+		std::pair<Move, float> searchRoot(const GameController& _game, std::vector<Move>& _moves, SearchState& _search, void* pThreadContext);
+		float evalRec(u32 _maxPlayer, GameController& _gameState, u32 _depth, vec2 _a_b, SearchState& _search, void* pThreadContext);
+		// Search order of moves: the transposition table move, the killers of the ply, then by history
+		void orderMoves(const GameController& _gameState, const GameController::MoveList& _moves, u32 _ttMove, u32 _depth, const SearchState& _search,
+			u8 (&_order)[GameController::cMaxMoveListSize]) const;
+		void recordCutoff(const GameController& _gameState, const Move& _move, u32 _depth, SearchState& _search) const;
 		// float computeScore(const GameController& _gameState, u32 _maxPlayer) const;
 
 	private:
 		const MinMaxAIHeuristic* m_pHeuristic;
 		u32 m_maxDepth = 10;
 		bool m_monothread = false;
+		u32 m_timeBudgetMs = 0;
+		u32 m_transpositionBudgetMB = 16;
 		std::atomic<u64> m_numNodeExplored = 0, m_numMoves = 0, n_numLeafEpxlored = 0;
-		std::atomic<bool> m_stopAI;
 	};
 }
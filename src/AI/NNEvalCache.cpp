@@ -0,0 +1,70 @@
+#include "NNEvalCache.h"
+
+// lookups of the calling thread since its last flushStats()
+static thread_local u64 t_numHits = 0;
+static thread_local u64 t_numMisses = 0;
+
+NNEvalCache::NNEvalCache(size_t memoryBudget)
+{
+	// power of two number of entries so the slot is a mask of the key
+	size_t numEntries = 1;
+	while (numEntries * 2 * sizeof(Entry) <= memoryBudget) {
+		numEntries *= 2;
+	}
+	m_entries = std::make_unique<Entry[]>(numEntries);
+	m_indexMask = numEntries - 1;
+}
+
+bool NNEvalCache::find(u64 _key, float& _value, float (&_priors)[cNumPriors])
+{
+	Entry& entry = m_entries[_key & m_indexMask];
+
+	const u32 sequence = entry.m_sequence.load(std::memory_order_acquire);
+	bool isHit = sequence != 0 && (sequence & 1) == 0 && entry.m_key.load(std::memory_order_relaxed) == _key;
+	if (isHit) {
+		_value = entry.m_value.load(std::memory_order_relaxed);
+		for (u32 i = 0; i < cNumPriors; ++i) {
+			_priors[i] = entry.m_priors[i].load(std::memory_order_relaxed);
+		}
+
+		// a writer started meanwhile, the copy may mix two entries
+		std::atomic_thread_fence(std::memory_order_acquire);
+		isHit = entry.m_sequence.load(std::memory_order_relaxed) == sequence;
+	}
+
+	++(isHit ? t_numHits : t_numMisses);
+	return isHit;
+}
+
+void NNEvalCache::store(u64 _key, float _value, const float* _priors)
+{
+	Entry& entry = m_entries[_key & m_indexMask];
+
+	u32 sequence = entry.m_sequence.load(std::memory_order_relaxed);
+	if ((sequence & 1) != 0 || !entry.m_sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed)) {
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	entry.m_key.store(_key, std::memory_order_relaxed);
+	entry.m_value.store(_value, std::memory_order_relaxed);
+	for (u32 i = 0; i < cNumPriors; ++i) {
+		entry.m_priors[i].store(_priors[i], std::memory_order_relaxed);
+	}
+
+	entry.m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void NNEvalCache::flushStats()
+{
+	m_numHits.fetch_add(t_numHits, std::memory_order_relaxed);
+	m_numMisses.fetch_add(t_numMisses, std::memory_order_relaxed);
+	t_numHits = 0;
+	t_numMisses = 0;
+}
+
+void NNEvalCache::resetStats()
+{
+	m_numHits.store(0, std::memory_order_relaxed);
+	m_numMisses.store(0, std::memory_order_relaxed);
+}
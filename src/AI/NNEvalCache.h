@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Core/Common.h"
+#include "Core/type.h"
+#include "7WDuel/GameController.h"
+
+#include <atomic>
+#include <memory>
+
+// Results of the network evaluations (value and raw PUCT priors) indexed by position, shared by all the threads of a
+// search and kept from one move to the next. The table has a fixed size, a new entry replaces the one in its slot.
+// Entries are guarded by a sequence counter: readers never wait and reject an entry being written, a writer gives up
+// when another thread is writing the same slot.
+class NNEvalCache
+{
+public:
+	static constexpr u32 cNumPriors = sevenWD::GameController::cMaxNumMoves;
+
+	explicit NNEvalCache(size_t memoryBudget);
+
+	// _generation identifies the network weights (BaseNN::getGeneration), entries of an older network never match
+	static u64 makeKey(u64 _positionHash, u32 _player, u32 _generation)
+	{
+		return _positionHash ^ (u64(_player) << 63) ^ (u64(_generation) * 0x9E3779B97F4A7C15ull);
+	}
+
+	bool find(u64 _key, float& _value, float (&_priors)[cNumPriors]);
+	void store(u64 _key, float _value, const float* _priors);
+
+	// find() counts its hits and misses per thread, a search adds the counts of its thread to the totals when done
+	void flushStats();
+	u64 getNumHits() const { return m_numHits.load(std::memory_order_relaxed); }
+	u64 getNumMisses() const { return m_numMisses.load(std::memory_order_relaxed); }
+	void resetStats();
+
+private:
+	struct Entry
+	{
+		std::atomic<u32> m_sequence = 0; // odd while written, 0 for an empty entry
+		std::atomic<u64> m_key = 0;
+		std::atomic<float> m_value = 0.0f;
+		std::atomic<float> m_priors[cNumPriors] = {};
+	};
+
+	std::unique_ptr<Entry[]> m_entries;
+	u64 m_indexMask = 0;
+
+	std::atomic<u64> m_numHits = 0;
+	std::atomic<u64> m_numMisses = 0;
+};
@@ -0,0 +1,318 @@
+#include "NNKernels.h"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NN_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NN_TARGET(isa)
+#else
+#define NN_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace NNKernels
+{
+	namespace
+	{
+		// Computes the pre-activations _output[o] = bias[o] + dot(row[o], _input) of the m_numOutputs outputs
+		using DenseFunc = void (*)(const DenseLayer& _layer, const float* _input, float* _output);
+
+		//----------------------------------------------------------------------------
+		void denseScalar(const DenseLayer& _layer, const float* _input, float* _output)
+		{
+			for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+			{
+				const float* row = _layer.m_weights.data() + o * _layer.m_stride;
+				float acc = 0.0f;
+				for (u32 i = 0; i < _layer.m_stride; ++i)
+					acc += row[i] * _input[i];
+				_output[o] = _layer.m_biases[o] + acc;
+			}
+		}
+
+		// Rows processed together by the batched kernels, they share the weight loads
+		constexpr u32 cBatchBlock = 4;
+
+		// Same as DenseFunc for _count inputs (and outputs) separated by a stride
+		using DenseBatchFunc = void (*)(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride, u32 _count);
+
+		//----------------------------------------------------------------------------
+		void denseBatchScalar(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride, u32 _count)
+		{
+			for (u32 r = 0; r < _count; ++r)
+				denseScalar(_layer, _inputs + r * _inputStride, _outputs + r * _outputStride);
+		}
+
+#ifdef NN_KERNELS_X86
+		//----------------------------------------------------------------------------
+		NN_TARGET("sse2") inline float horizontalSum(__m128 _v)
+		{
+			__m128 sum = _mm_add_ps(_v, _mm_movehl_ps(_v, _v));
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+			return _mm_cvtss_f32(sum);
+		}
+
+		//----------------------------------------------------------------------------
+		NN_TARGET("sse2") void denseSSE2(const DenseLayer& _layer, const float* _input, float* _output)
+		{
+			for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+			{
+				const float* row = _layer.m_weights.data() + o * _layer.m_stride;
+				__m128 acc0 = _mm_setzero_ps();
+				__m128 acc1 = _mm_setzero_ps();
+				for (u32 i = 0; i < _layer.m_stride; i += cLaneWidth)
+				{
+					acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(row + i), _mm_load_ps(_input + i)));
+					acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(row + i + 4), _mm_load_ps(_input + i + 4)));
+				}
+				_output[o] = _layer.m_biases[o] + horizontalSum(_mm_add_ps(acc0, acc1));
+			}
+		}
+
+		//----------------------------------------------------------------------------
+		NN_TARGET("sse2") void denseBatchSSE2(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride, u32 _count)
+		{
+			u32 r = 0;
+			for (; r + cBatchBlock <= _count; r += cBatchBlock)
+			{
+				const float* in0 = _inputs + r * _inputStride;
+				const float* in1 = in0 + _inputStride;
+				const float* in2 = in1 + _inputStride;
+				const float* in3 = in2 + _inputStride;
+				float* out = _outputs + r * _outputStride;
+
+				for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+				{
+					const float* row = _layer.m_weights.data() + o * _layer.m_stride;
+					__m128 acc0 = _mm_setzero_ps();
+					__m128 acc1 = _mm_setzero_ps();
+					__m128 acc2 = _mm_setzero_ps();
+					__m128 acc3 = _mm_setzero_ps();
+					for (u32 i = 0; i < _layer.m_stride; i += 4)
+					{
+						const __m128 w = _mm_load_ps(row + i);
+						acc0 = _mm_add_ps(acc0, _mm_mul_ps(w, _mm_load_ps(in0 + i)));
+						acc1 = _mm_add_ps(acc1, _mm_mul_ps(w, _mm_load_ps(in1 + i)));
+						acc2 = _mm_add_ps(acc2, _mm_mul_ps(w, _mm_load_ps(in2 + i)));
+						acc3 = _mm_add_ps(acc3, _mm_mul_ps(w, _mm_load_ps(in3 + i)));
+					}
+					const float bias = _layer.m_biases[o];
+					out[o] = bias + horizontalSum(acc0);
+					out[_outputStride + o] = bias + horizontalSum(acc1);
+					out[2 * _outputStride + o] = bias + horizontalSum(acc2);
+					out[3 * _outputStride + o] = bias + horizontalSum(acc3);
+				}
+			}
+
+			for (; r < _count; ++r)
+				denseSSE2(_layer, _inputs + r * _inputStride, _outputs + r * _outputStride);
+		}
+
+		//----------------------------------------------------------------------------
+		NN_TARGET("avx2,fma") inline float horizontalSum256(__m256 _v)
+		{
+			return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(_v), _mm256_extractf128_ps(_v, 1)));
+		}
+
+		//----------------------------------------------------------------------------
+		NN_TARGET("avx2,fma") void denseAVX2(const DenseLayer& _layer, const float* _input, float* _output)
+		{
+			for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+			{
+				const float* row = _layer.m_weights.data() + o * _layer.m_stride;
+				__m256 acc = _mm256_setzero_ps();
+				for (u32 i = 0; i < _layer.m_stride; i += cLaneWidth)
+					acc = _mm256_fmadd_ps(_mm256_load_ps(row + i), _mm256_load_ps(_input + i), acc);
+
+				_output[o] = _layer.m_biases[o] + horizontalSum256(acc);
+			}
+		}
+
+		//----------------------------------------------------------------------------
+		NN_TARGET("avx2,fma") void denseBatchAVX2(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride, u32 _count)
+		{
+			u32 r = 0;
+			for (; r + cBatchBlock <= _count; r += cBatchBlock)
+			{
+				const float* in0 = _inputs + r * _inputStride;
+				const float* in1 = in0 + _inputStride;
+				const float* in2 = in1 + _inputStride;
+				const float* in3 = in2 + _inputStride;
+				float* out = _outputs + r * _outputStride;
+
+				for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+				{
+					const float* row = _layer.m_weights.data() + o * _layer.m_stride;
+					__m256 acc0 = _mm256_setzero_ps();
+					__m256 acc1 = _mm256_setzero_ps();
+					__m256 acc2 = _mm256_setzero_ps();
+					__m256 acc3 = _mm256_setzero_ps();
+					for (u32 i = 0; i < _layer.m_stride; i += cLaneWidth)
+					{
+						const __m256 w = _mm256_load_ps(row + i);
+						acc0 = _mm256_fmadd_ps(w, _mm256_load_ps(in0 + i), acc0);
+						acc1 = _mm256_fmadd_ps(w, _mm256_load_ps(in1 + i), acc1);
+						acc2 = _mm256_fmadd_ps(w, _mm256_load_ps(in2 + i), acc2);
+						acc3 = _mm256_fmadd_ps(w, _mm256_load_ps(in3 + i), acc3);
+					}
+					const float bias = _layer.m_biases[o];
+					out[o] = bias + horizontalSum256(acc0);
+					out[_outputStride + o] = bias + horizontalSum256(acc1);
+					out[2 * _outputStride + o] = bias + horizontalSum256(acc2);
+					out[3 * _outputStride + o] = bias + horizontalSum256(acc3);
+				}
+			}
+
+			for (; r < _count; ++r)
+				denseAVX2(_layer, _inputs + r * _inputStride, _outputs + r * _outputStride);
+		}
+
+		//----------------------------------------------------------------------------
+		bool hasAVX2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+
+			__cpuid(info, 1);
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			if (!fma || !osxsave || !avx)
+				return false;
+
+			// the OS must save the ymm registers on context switches
+			if ((_xgetbv(0) & 0x6) != 0x6)
+				return false;
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init(); // may run from a static initializer, before the runtime does it
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+
+		//----------------------------------------------------------------------------
+		bool hasSSE2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 26)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+#endif
+		}
+#endif
+
+		struct Dispatch
+		{
+			DenseFunc m_dense;
+			DenseBatchFunc m_denseBatch;
+			const char* m_name;
+		};
+
+		//----------------------------------------------------------------------------
+		Dispatch selectKernels()
+		{
+#ifdef NN_KERNELS_X86
+			if (hasAVX2())
+				return { denseAVX2, denseBatchAVX2, "AVX2" };
+			if (hasSSE2())
+				return { denseSSE2, denseBatchSSE2, "SSE2" };
+#endif
+			return { denseScalar, denseBatchScalar, "Scalar" };
+		}
+
+		const Dispatch s_dispatch = selectKernels();
+	}
+
+	//----------------------------------------------------------------------------
+	void DenseLayer::pack(const float* _weights, const float* _biases, u32 _numInputs, u32 _numOutputs,
+		const float* _inputScale, const float* _inputShift)
+	{
+		DEBUG_ASSERT((_inputScale == nullptr) == (_inputShift == nullptr));
+
+		m_numInputs = _numInputs;
+		m_numOutputs = _numOutputs;
+		m_stride = paddedSize(_numInputs);
+
+		m_weights.assign(size_t(m_stride) * _numOutputs, 0.0f);
+		m_biases.assign(_numOutputs, 0.0f);
+
+		for (u32 o = 0; o < _numOutputs; ++o)
+		{
+			float* row = m_weights.data() + o * m_stride;
+			double bias = _biases[o];
+			for (u32 i = 0; i < _numInputs; ++i)
+			{
+				const float w = _weights[i * _numOutputs + o];
+				if (_inputScale)
+				{
+					// w * (x - shift) * scale = (w * scale) * x - w * scale * shift
+					row[i] = w * _inputScale[i];
+					bias -= double(row[i]) * _inputShift[i];
+				}
+				else
+					row[i] = w;
+			}
+			m_biases[o] = float(bias);
+		}
+	}
+
+	//----------------------------------------------------------------------------
+	static void applyActivation(const DenseLayer& _layer, float* _output, Activation _activation)
+	{
+		if (_activation == Activation::ReLU)
+		{
+			for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+				_output[o] = _output[o] > 0.0f ? _output[o] : 0.0f;
+		}
+		else
+		{
+			for (u32 o = 0; o < _layer.m_numOutputs; ++o)
+				_output[o] = 1.0f / (1.0f + std::exp(-_output[o]));
+		}
+
+		for (u32 o = _layer.m_numOutputs; o < paddedSize(_layer.m_numOutputs); ++o)
+			_output[o] = 0.0f;
+	}
+
+	//----------------------------------------------------------------------------
+	void dense(const DenseLayer& _layer, const float* _input, float* _output, Activation _activation)
+	{
+		DEBUG_ASSERT(!_layer.empty());
+		DEBUG_ASSERT((reinterpret_cast<uintptr_t>(_input) % cAlignment) == 0);
+
+		s_dispatch.m_dense(_layer, _input, _output);
+		applyActivation(_layer, _output, _activation);
+	}
+
+	//----------------------------------------------------------------------------
+	void denseBatch(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride,
+		u32 _count, Activation _activation)
+	{
+		DEBUG_ASSERT(!_layer.empty());
+		DEBUG_ASSERT((reinterpret_cast<uintptr_t>(_inputs) % cAlignment) == 0);
+		DEBUG_ASSERT(_inputStride % cLaneWidth == 0 && _inputStride >= _layer.m_stride);
+		DEBUG_ASSERT(_outputStride % cLaneWidth == 0 && _outputStride >= paddedSize(_layer.m_numOutputs));
+
+		s_dispatch.m_denseBatch(_layer, _inputs, _inputStride, _outputs, _outputStride, _count);
+		for (u32 r = 0; r < _count; ++r)
+			applyActivation(_layer, _outputs + r * _outputStride, _activation);
+	}
+
+	//----------------------------------------------------------------------------
+	const char* getInstructionSetName()
+	{
+		return s_dispatch.m_name;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Core/Common.h"
+#include "Core/type.h"
+
+#include <new>
+#include <vector>
+
+// Inference kernels of the hand written network forward passes (see NetworkDef.h).
+// Weights are repacked once after loading into an aligned, output-major layout so each output is a
+// contiguous dot product, the best instruction set (AVX2+FMA, SSE2 or scalar) is selected at runtime.
+namespace NNKernels
+{
+	constexpr u32 cAlignment = 32;
+	constexpr u32 cLaneWidth = 8; // floats per AVX register, rows and activations are padded to a multiple of it
+
+	constexpr u32 paddedSize(u32 _size) { return (_size + cLaneWidth - 1) & ~(cLaneWidth - 1); }
+
+	template<typename T>
+	struct AlignedAllocator
+	{
+		using value_type = T;
+
+		AlignedAllocator() = default;
+		template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+		T* allocate(size_t _count) { return static_cast<T*>(::operator new(_count * sizeof(T), std::align_val_t(cAlignment))); }
+		void deallocate(T* _ptr, size_t) { ::operator delete(_ptr, std::align_val_t(cAlignment)); }
+
+		template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+		template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+	};
+	using AlignedVector = std::vector<float, AlignedAllocator<float>>;
+
+	// Fully connected layer packed for inference: one row of m_stride floats per output, the padding is zero
+	struct DenseLayer
+	{
+		AlignedVector m_weights;
+		AlignedVector m_biases;
+		u32 m_numInputs = 0;
+		u32 m_numOutputs = 0;
+		u32 m_stride = 0;
+
+		// _weights uses the tiny-dnn input-major layout: _weights[i * _numOutputs + o].
+		// When given, the per input transform x' = (x - _inputShift[i]) * _inputScale[i] (inference batch-norm)
+		// is folded into the packed weights and biases.
+		void pack(const float* _weights, const float* _biases, u32 _numInputs, u32 _numOutputs,
+			const float* _inputScale = nullptr, const float* _inputShift = nullptr);
+
+		bool empty() const { return m_weights.empty(); }
+	};
+
+	enum class Activation
+	{
+		ReLU,
+		Sigmoid
+	};
+
+	// _input is 32 bytes aligned and holds _layer.m_stride floats, its padding meets zero weights so it only has to be finite.
+	// _output is 32 bytes aligned and receives paddedSize(m_numOutputs) floats, the padding is zeroed so it can
+	// directly feed the next layer.
+	void dense(const DenseLayer& _layer, const float* _input, float* _output, Activation _activation);
+
+	// dense() over _count inputs at once, each weight row is loaded once for several inputs.
+	// Inputs and outputs are rows of _inputStride and _outputStride floats (multiples of cLaneWidth) with the same
+	// requirements as in dense().
+	void denseBatch(const DenseLayer& _layer, const float* _inputs, u32 _inputStride, float* _outputs, u32 _outputStride,
+		u32 _count, Activation _activation);
+
+	// Name of the instruction set picked at startup, for logs
+	const char* getInstructionSetName();
+}
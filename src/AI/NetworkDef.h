@@ -1,7 +1,23 @@
 #include "ML.h"
+#include "NNKernels.h"
 
 #ifdef USE_TINY_DNN
 
+// Batched forward pass of dense(ReLU) -> dense(sigmoid) networks, HiddenSize activations per row
+template<u32 HiddenSize>
+void forwardTwoDenseBatch(const NNKernels::DenseLayer& layer1, const NNKernels::DenseLayer& layer2, const float* inputs, float* outputs, u32 count)
+{
+	constexpr u32 kBlockSize = 64; // rows per pass, bounds the hidden activations kept on the stack
+	constexpr u32 kHiddenStride = NNKernels::paddedSize(HiddenSize);
+	alignas(NNKernels::cAlignment) float hidden[kBlockSize * kHiddenStride];
+
+	for (u32 first = 0; first < count; first += kBlockSize) {
+		const u32 numRows = std::min(kBlockSize, count - first);
+		NNKernels::denseBatch(layer1, inputs + first * BaseNN::cMaxInputSize, BaseNN::cMaxInputSize, hidden, kHiddenStride, numRows, NNKernels::Activation::ReLU);
+		NNKernels::denseBatch(layer2, hidden, kHiddenStride, outputs + first * BaseNN::cMaxOutputSize, BaseNN::cMaxOutputSize, numRows, NNKernels::Activation::Sigmoid);
+	}
+}
+
 template<u32 SecondLayerSize>
 struct TwoLayers : BaseNN
 {
@@ -17,22 +33,18 @@ struct TwoLayers : BaseNN
 			<< tiny_dnn::fully_connected_layer(SecondLayerSize, 1)
 			<< tiny_dnn::sigmoid_layer();
 
-		m_layer1Weights = nullptr;
-		m_layer2Weights = nullptr;
-		m_layer1Biases = nullptr;
-		m_layer2Biases = nullptr;
 		m_inputSize = tensorSize;
 	}
 
-	// Raw pointers into tiny-dnn internal buffers (set by prepareAfterLoad)
-	float* m_layer1Weights = nullptr; // size: SecondLayerSize * inputSize
-	float* m_layer2Weights = nullptr; // size: SecondLayerSize * 1
-	float* m_layer1Biases = nullptr; // size: SecondLayerSize
-	float* m_layer2Biases = nullptr; // size: 1
-	u32    m_inputSize = 0;
+	// Copies of the tiny-dnn weights repacked for the SIMD kernels (set by prepareAfterLoad)
+	NNKernels::DenseLayer m_layer1; // inputSize -> SecondLayerSize
+	NNKernels::DenseLayer m_layer2; // SecondLayerSize -> 1
+	u32 m_inputSize = 0;
 
 	void prepareAfterLoad() override
 	{
+		BaseNN::prepareAfterLoad();
+
 		// Network layout:
 		// [0] fully_connected(input -> SecondLayerSize)
 		// [1] relu
@@ -40,86 +52,57 @@ struct TwoLayers : BaseNN
 		// [3] sigmoid
 		using fc_layer = tiny_dnn::fully_connected_layer;
 
-		// Layer 0: first fully-connected
-		if (m_net.layer_size() > 0) {
-			auto* l0 = dynamic_cast<fc_layer*>(m_net[0]);
-			if (l0) {
-				// tiny-dnn stores weights/biases in layer->weights():
-				// weights()[0] = weight matrix, weights()[1] = bias vector (both as vec_t)
-				auto& w0_ptr = *l0->weights()[0];
-				auto& b0_ptr = *l0->weights()[1];
+		m_layer1 = {};
+		m_layer2 = {};
 
-				tiny_dnn::vec_t& w0 = w0_ptr; // weight matrix
-				tiny_dnn::vec_t& b0 = b0_ptr; // bias vector
+		if (m_net.layer_size() <= 2)
+			return;
 
-				m_layer1Weights = w0.empty() ? nullptr : w0.data();
-				m_layer1Biases = b0.empty() ? nullptr : b0.data();
+		auto* l0 = dynamic_cast<fc_layer*>(m_net[0]);
+		auto* l2 = dynamic_cast<fc_layer*>(m_net[2]);
+		if (!l0 || !l2)
+			return;
 
-				// Keep input size in sync (tiny-dnn exposes in_size/out_size)
-				m_inputSize = static_cast<u32>(l0->in_size());
-			}
-		}
-
-		// Layer 2: second fully-connected
-		if (m_net.layer_size() > 2) {
-			auto* l2 = dynamic_cast<fc_layer*>(m_net[2]);
-			if (l2) {
-				auto& w2_ptr = *l2->weights()[0];
-				auto& b2_ptr = *l2->weights()[1];
+		// tiny-dnn stores weights/biases in layer->weights():
+		// weights()[0] = weight matrix (input-major), weights()[1] = bias vector (both as vec_t)
+		const tiny_dnn::vec_t& w0 = *l0->weights()[0];
+		const tiny_dnn::vec_t& b0 = *l0->weights()[1];
+		const tiny_dnn::vec_t& w2 = *l2->weights()[0];
+		const tiny_dnn::vec_t& b2 = *l2->weights()[1];
+		if (w0.empty() || b0.empty() || w2.empty() || b2.empty())
+			return;
 
-				tiny_dnn::vec_t& w2 = w2_ptr;
-				tiny_dnn::vec_t& b2 = b2_ptr;
+		// Keep input size in sync (tiny-dnn exposes in_size/out_size)
+		m_inputSize = static_cast<u32>(l0->in_size());
 
-				m_layer2Weights = w2.empty() ? nullptr : w2.data();
-				m_layer2Biases = b2.empty() ? nullptr : b2.data();
-			}
-		}
+		m_layer1.pack(w0.data(), b0.data(), m_inputSize, SecondLayerSize);
+		m_layer2.pack(w2.data(), b2.data(), SecondLayerSize, 1);
 	}
 
-	// Manual, allocation-light forward pass using cached weight/bias pointers.
-	tiny_dnn::vec_t forward(const tiny_dnn::vec_t& x, void* pThreadContext, u32 netAge) override
+	// Manual, allocation-free forward pass using the packed weights.
+	void forward(Buffers& buffers) const override
 	{
-		// Fallback to tiny-dnn if we don't have direct pointers (e.g., not prepared)
-		if (!m_layer1Weights || !m_layer2Weights || !m_layer1Biases || !m_layer2Biases) {
-			return BaseNN::forward(x, pThreadContext, netAge);
+		// Fallback to tiny-dnn if the weights are not packed (e.g., not prepared)
+		if (m_layer1.empty() || m_layer2.empty()) {
+			return BaseNN::forward(buffers);
 		}
 
-		DEBUG_ASSERT(x.size() == m_inputSize);
-
-		// First layer: y1 = relu(W1 * x + b1)
-		// - W1: SecondLayerSize x inputSize, row-major
-		// - b1: SecondLayerSize
-		// Second layer: y2 = sigmoid(W2 * y1 + b2)
-		// - W2: 1 x SecondLayerSize
-		float hidden[SecondLayerSize];
-
-		// L1: dense + ReLU
-		for (u32 o = 0; o < SecondLayerSize; ++o) {
-			float acc = m_layer1Biases[o];
-			// dot product
-			for (u32 i = 0; i < m_inputSize; ++i) {
-				acc += m_layer1Weights[i * SecondLayerSize + o] * x[i];
-			}
-			// ReLU
-			hidden[o] = acc > 0.0f ? acc : 0.0f;
-		}
-
-		// L2: dense + sigmoid, output size is 1
-		float acc2 = m_layer2Biases[0];
-		for (u32 i = 0; i < SecondLayerSize; ++i) {
-			acc2 += m_layer2Weights[i] * hidden[i];
-		}
-
-		// Sigmoid
-		float out = 1.0f / (1.0f + std::exp(-acc2));
+		DEBUG_ASSERT(getInputSize() == m_inputSize);
+		DEBUG_ASSERT(m_layer1.m_stride <= cMaxInputSize);
 
-		tiny_dnn::vec_t result(1);
-		result[0] = out;
+		// L1: y1 = relu(W1 * x + b1), L2: y2 = sigmoid(W2 * y1 + b2)
+		alignas(NNKernels::cAlignment) float hidden[NNKernels::paddedSize(SecondLayerSize)];
+		NNKernels::dense(m_layer1, buffers.m_input, hidden, NNKernels::Activation::ReLU);
+		NNKernels::dense(m_layer2, hidden, buffers.m_output, NNKernels::Activation::Sigmoid);
+	}
 
-		//float test = BaseNN::forward(x, pThreadContext, netAge)[0];
-		//DEBUG_ASSERT(std::abs(test - out) < 1e-5f);
+	void forwardBatch(const float* inputs, float* outputs, u32 count) const override
+	{
+		if (m_layer1.empty() || m_layer2.empty()) {
+			return BaseNN::forwardBatch(inputs, outputs, count);
+		}
 
-		return result;
+		forwardTwoDenseBatch<SecondLayerSize>(m_layer1, m_layer2, inputs, outputs, count);
 	}
 };
 
@@ -170,33 +153,22 @@ struct TwoLayersPUCT : BaseNN
 			<< tiny_dnn::fully_connected_layer(SecondLayerSize, 1 + sevenWD::GameController::cMaxNumMoves)
 			<< tiny_dnn::sigmoid_layer();
 
-		m_bnMean = nullptr;
-		m_bnVariance = nullptr;
-		m_bnEpsilon = 0.0f;
-
-		m_layer1Weights = nullptr;
-		m_layer2Weights = nullptr;
-		m_layer1Biases = nullptr;
-		m_layer2Biases = nullptr;
 		m_inputSize = tensorSize;
 	}
 
-	// Batch-norm (inference): y = (x - mean) / sqrt(variance + eps)
-	// Note: stored per-channel; here channels == tensorSize and spatial == 1.
-	float* m_bnMean = nullptr;     // size: inputSize
-	float* m_bnVariance = nullptr; // size: inputSize
-	float  m_bnEpsilon = 0.0f;
+	static constexpr u32 kOutSize = 1u + sevenWD::GameController::cMaxNumMoves;
 
-	// First FC: tensorSize -> SecondLayerSize
+	// First FC: tensorSize -> SecondLayerSize, with the inference batch-norm y = (x - mean) / sqrt(variance + eps)
+	// folded into its weights and biases (channels == tensorSize and spatial == 1)
 	// Second FC: SecondLayerSize -> (1 + cMaxNumMoves) [value + policy]
-	float* m_layer1Weights = nullptr; // size: SecondLayerSize * inputSize
-	float* m_layer1Biases = nullptr;  // size: SecondLayerSize
-	float* m_layer2Weights = nullptr; // size: (1 + cMaxNumMoves) * SecondLayerSize
-	float* m_layer2Biases = nullptr;  // size: 1 + cMaxNumMoves
-	u32    m_inputSize = 0;
+	NNKernels::DenseLayer m_layer1;
+	NNKernels::DenseLayer m_layer2;
+	u32 m_inputSize = 0;
 
 	void prepareAfterLoad() override
 	{
+		BaseNN::prepareAfterLoad();
+
 		using bn_layer = tiny_dnn::batch_normalization_layer;
 		using fc_layer = tiny_dnn::fully_connected_layer;
 
@@ -207,95 +179,63 @@ struct TwoLayersPUCT : BaseNN
 		// [3] fully_connected(SecondLayerSize -> 1 + cMaxNumMoves)
 		// [4] sigmoid
 
-		// Layer 0: batch-norm
-		if (m_net.layer_size() > 0) {
-			auto* l0 = dynamic_cast<bn_layer*>(m_net[0]);
-			if (l0) {
-				auto& mean = l0->mean_;
-				auto& variance = l0->variance_;
-
-				m_bnMean = mean.empty() ? nullptr : mean.data();
-				m_bnVariance = variance.empty() ? nullptr : variance.data();
-				m_bnEpsilon = static_cast<float>(l0->epsilon());
-			}
-		}
-
-		// Layer 1: first fully-connected
-		if (m_net.layer_size() > 1) {
-			auto* l1 = dynamic_cast<fc_layer*>(m_net[1]);
-			if (l1) {
-				auto& w1_ref = *l1->weights()[0];
-				auto& b1_ref = *l1->weights()[1];
-
-				tiny_dnn::vec_t& w1 = w1_ref;
-				tiny_dnn::vec_t& b1 = b1_ref;
-
-				m_layer1Weights = w1.empty() ? nullptr : w1.data();
-				m_layer1Biases = b1.empty() ? nullptr : b1.data();
-
-				m_inputSize = static_cast<u32>(l1->in_size());
-			}
-		}
-
-		// Layer 3: second fully-connected
-		if (m_net.layer_size() > 3) {
-			auto* l3 = dynamic_cast<fc_layer*>(m_net[3]);
-			if (l3) {
-				auto& w3_ref = *l3->weights()[0];
-				auto& b3_ref = *l3->weights()[1];
-
-				tiny_dnn::vec_t& w3 = w3_ref;
-				tiny_dnn::vec_t& b3 = b3_ref;
-
-				m_layer2Weights = w3.empty() ? nullptr : w3.data();
-				m_layer2Biases = b3.empty() ? nullptr : b3.data();
-			}
-		}
+		m_layer1 = {};
+		m_layer2 = {};
+
+		if (m_net.layer_size() <= 3)
+			return;
+
+		auto* l0 = dynamic_cast<bn_layer*>(m_net[0]);
+		auto* l1 = dynamic_cast<fc_layer*>(m_net[1]);
+		auto* l3 = dynamic_cast<fc_layer*>(m_net[3]);
+		if (!l0 || !l1 || !l3)
+			return;
+
+		const tiny_dnn::vec_t& mean = l0->mean_;
+		const tiny_dnn::vec_t& variance = l0->variance_;
+		const tiny_dnn::vec_t& w1 = *l1->weights()[0];
+		const tiny_dnn::vec_t& b1 = *l1->weights()[1];
+		const tiny_dnn::vec_t& w3 = *l3->weights()[0];
+		const tiny_dnn::vec_t& b3 = *l3->weights()[1];
+		if (mean.empty() || variance.empty() || w1.empty() || b1.empty() || w3.empty() || b3.empty())
+			return;
+
+		m_inputSize = static_cast<u32>(l1->in_size());
+		DEBUG_ASSERT(mean.size() == m_inputSize && variance.size() == m_inputSize);
+
+		const float epsilon = static_cast<float>(l0->epsilon());
+		std::vector<float> bnScale(m_inputSize);
+		for (u32 i = 0; i < m_inputSize; ++i)
+			bnScale[i] = 1.0f / std::sqrt(variance[i] + epsilon);
+
+		m_layer1.pack(w1.data(), b1.data(), m_inputSize, SecondLayerSize, bnScale.data(), mean.data());
+		m_layer2.pack(w3.data(), b3.data(), SecondLayerSize, kOutSize);
 	}
 
-	// Manual, allocation-light forward pass
-	tiny_dnn::vec_t forward(const tiny_dnn::vec_t& x, void* pThreadContext, u32 netAge) override
+	// Manual, allocation-free forward pass
+	void forward(Buffers& buffers) const override
 	{
-		if (!m_bnMean || !m_bnVariance || !m_layer1Weights || !m_layer2Weights || !m_layer1Biases || !m_layer2Biases) {
-			return BaseNN::forward(x, pThreadContext, netAge);
+		if (m_layer1.empty() || m_layer2.empty()) {
+			return BaseNN::forward(buffers);
 		}
 
-		DEBUG_ASSERT(x.size() == m_inputSize);
-
-		constexpr u32 kOutSize = 1u + sevenWD::GameController::cMaxNumMoves;
+		DEBUG_ASSERT(getInputSize() == m_inputSize);
+		DEBUG_ASSERT(m_layer1.m_stride <= cMaxInputSize);
+		static_assert(NNKernels::paddedSize(kOutSize) <= cMaxOutputSize);
 
-		// BN output (spatial=1, channels=inputSize): bn[i] = (x[i] - mean[i]) / sqrt(var[i] + eps)
-		float bnOut[sevenWD::GameState::TensorSize + sevenWD::GameState::ExtraTensorSize];
-
-		DEBUG_ASSERT(m_inputSize <= (sizeof(bnOut) / sizeof(bnOut[0])));
-
-		for (u32 i = 0; i < m_inputSize; ++i) {
-			const float denom = std::sqrt(m_bnVariance[i] + m_bnEpsilon);
-			bnOut[i] = (x[i] - m_bnMean[i]) / denom;
-		}
-
-		// First FC + ReLU: y1 = relu(W1 * bnOut + b1)
-		float hidden[SecondLayerSize];
-
-		for (u32 o = 0; o < SecondLayerSize; ++o) {
-			float acc = m_layer1Biases[o];
-			for (u32 i = 0; i < m_inputSize; ++i) {
-				acc += m_layer1Weights[i * SecondLayerSize + o] * bnOut[i];
-			}
-			hidden[o] = acc > 0.0f ? acc : 0.0f;
-		}
+		// First FC + ReLU: y1 = relu(W1 * bn(x) + b1), second FC + sigmoid: out[o] = sigmoid(W2 * y1 + b2)
+		alignas(NNKernels::cAlignment) float hidden[NNKernels::paddedSize(SecondLayerSize)];
+		NNKernels::dense(m_layer1, buffers.m_input, hidden, NNKernels::Activation::ReLU);
+		NNKernels::dense(m_layer2, hidden, buffers.m_output, NNKernels::Activation::Sigmoid);
+	}
 
-		// Second FC + sigmoid: out[o] = sigmoid(W2 * hidden + b2)
-		tiny_dnn::vec_t result(kOutSize);
-		for (u32 o = 0; o < kOutSize; ++o) {
-			float acc = m_layer2Biases[o];
-			for (u32 i = 0; i < SecondLayerSize; ++i) {
-				acc += m_layer2Weights[i * kOutSize + o] * hidden[i];
-			}
-			result[o] = 1.0f / (1.0f + std::exp(-acc));
+	void forwardBatch(const float* inputs, float* outputs, u32 count) const override
+	{
+		if (m_layer1.empty() || m_layer2.empty()) {
+			return BaseNN::forwardBatch(inputs, outputs, count);
 		}
 
-		return result;
+		forwardTwoDenseBatch<SecondLayerSize>(m_layer1, m_layer2, inputs, outputs, count);
 	}
 };
 
@@ -317,6 +257,45 @@ struct BaseLine : BaseNN
 
 		m_net << tiny_dnn::fully_connected_layer(tensorSize, 1) << tiny_dnn::sigmoid_layer();
 	}
+
+	NNKernels::DenseLayer m_layer; // inputSize -> 1
+
+	void prepareAfterLoad() override
+	{
+		BaseNN::prepareAfterLoad();
+
+		// [0] fully_connected(input -> 1)
+		// [1] sigmoid
+		m_layer = {};
+
+		auto* l0 = m_net.layer_size() > 0 ? dynamic_cast<tiny_dnn::fully_connected_layer*>(m_net[0]) : nullptr;
+		if (!l0)
+			return;
+
+		const tiny_dnn::vec_t& w0 = *l0->weights()[0];
+		const tiny_dnn::vec_t& b0 = *l0->weights()[1];
+		if (!w0.empty() && !b0.empty())
+			m_layer.pack(w0.data(), b0.data(), static_cast<u32>(l0->in_size()), 1);
+	}
+
+	void forward(Buffers& buffers) const override
+	{
+		if (m_layer.empty()) {
+			return BaseNN::forward(buffers);
+		}
+
+		DEBUG_ASSERT(m_layer.m_numInputs == getInputSize());
+		NNKernels::dense(m_layer, buffers.m_input, buffers.m_output, NNKernels::Activation::Sigmoid);
+	}
+
+	void forwardBatch(const float* inputs, float* outputs, u32 count) const override
+	{
+		if (m_layer.empty()) {
+			return BaseNN::forwardBatch(inputs, outputs, count);
+		}
+
+		NNKernels::denseBatch(m_layer, inputs, cMaxInputSize, outputs, cMaxOutputSize, count, NNKernels::Activation::Sigmoid);
+	}
 };
 
 #else
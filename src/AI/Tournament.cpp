@@ -1,5 +1,6 @@
 
 #include "Tournament.h"
+#include "Core/Scheduler.h"
 
 Tournament::Tournament()
 {
@@ -34,7 +35,10 @@ void Tournament::generateDataset(const sevenWD::GameContext& context, u32 numGam
 	std::mutex printMutex;
 	u32 printIndex = 0;
 
-	std::for_each(Tournament::ExecPolicy, perThreadDataset.begin(), perThreadDataset.end(), [&](auto& threadSafeDataset) {
+	// the games run on the scheduler workers, the searches they start share the same workers
+	core::TaskGroup games;
+	for (size_t t = 0; t < perThreadDataset.size(); ++t) games.run([&, t]() {
+		auto& threadSafeDataset = perThreadDataset[t];
 		std::vector<void*> perThreadAIContext(m_AIs.size());
 		for (size_t i = 0; i < m_AIs.size(); ++i) {
 			perThreadAIContext[i] = m_AIs[i]->createPerThreadContext();
@@ -47,6 +51,8 @@ void Tournament::generateDataset(const sevenWD::GameContext& context, u32 numGam
 
 			auto [i, j] = aiMatches[nextGameIndex % aiMatches.size()];
 
+			// one random stream per game, the dataset does not depend on the thread scheduling (stream 0 is the main thread one)
+			context.seedRand(nextGameIndex + 1);
 			playOneGame(context, threadSafeDataset, i, j, perThreadAIContext[i], perThreadAIContext[j]);
 
 			{
@@ -59,6 +65,7 @@ void Tournament::generateDataset(const sevenWD::GameContext& context, u32 numGam
 			m_AIs[i]->destroyPerThreadContext(perThreadAIContext[i]);
 		}
 	});
+	games.wait();
 
 	for (const auto& dataset : perThreadDataset) {
 		m_dataset[0] += dataset[0];
@@ -80,7 +87,9 @@ void Tournament::generateDatasetFromAI(const sevenWD::GameContext& context, seve
 
 	std::atomic_uint printCounter = 0;
 
-	std::for_each(Tournament::ExecPolicy, perThreadDataset.begin(), perThreadDataset.end(), [&](auto& threadSafeDataset) {
+	core::TaskGroup games;
+	for (size_t t = 0; t < perThreadDataset.size(); ++t) games.run([&, t]() {
+		auto& threadSafeDataset = perThreadDataset[t];
 		u32 parity = 0;
 
 		std::vector<void*> perThreadAIContext(m_AIs.size());
@@ -109,6 +118,7 @@ void Tournament::generateDatasetFromAI(const sevenWD::GameContext& context, seve
 			m_AIs[i]->destroyPerThreadContext(perThreadAIContext[i]);
 		}
 	});
+	games.wait();
 
 	for (const auto& dataset : perThreadDataset) {
 		m_dataset[0] += dataset[0];
@@ -7,8 +7,6 @@
 class Tournament
 {
 public:
-	static constexpr auto ExecPolicy = std::execution::par;
-
 	Tournament();
 
 	void addAI(sevenWD::AIInterface* pAI);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "type.h"
+
+#include <chrono>
+#include <atomic>
+
+namespace core
+{
+	// Wall clock budget of a search, polled from the search loops. A default constructed or zero budget never expires.
+	// An optional stop flag ends the search early whatever the budget left, e.g. a background search when the result is
+	// wanted now.
+	class Deadline
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		Deadline() = default;
+		explicit Deadline(u32 _budgetMs)
+			: m_start(Clock::now())
+			, m_end(m_start + std::chrono::milliseconds(_budgetMs))
+			, m_isSet(_budgetMs > 0)
+		{}
+
+		// The flag must outlive the deadline and its slices
+		Deadline withStopFlag(const std::atomic<bool>* _pStop) const
+		{
+			Deadline deadline = *this;
+			deadline.m_pStop = _pStop;
+			return deadline;
+		}
+
+		bool isSet() const { return m_isSet; }
+		bool hasExpired() const
+		{
+			if (m_pStop && m_pStop->load(std::memory_order_relaxed))
+				return true;
+			return m_isSet && Clock::now() >= m_end;
+		}
+
+		// Slice _index when the budget is split in _count equal consecutive slices, searches run one after the other
+		// then share the budget evenly and the time left by a search ending early goes to the next one
+		Deadline getSlice(u32 _index, u32 _count) const
+		{
+			if (!m_isSet)
+				return *this;
+
+			Deadline slice = *this;
+			slice.m_end = m_start + (m_end - m_start) * (_index + 1) / _count;
+			return slice;
+		}
+
+	private:
+		Clock::time_point m_start;
+		Clock::time_point m_end;
+		bool m_isSet = false;
+		const std::atomic<bool>* m_pStop = nullptr;
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Common.h"
+
+#include <array>
+#include <type_traits>
+
+namespace core
+{
+	// Vector with an inline storage of _Capacity elements, never allocates.
+	// Meant for small lists of trivial types built in hot loops (moves, card ids).
+	template<typename T, u32 _Capacity>
+	class FixedVector
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "FixedVector does not run destructors");
+
+	public:
+		static constexpr u32 Capacity = _Capacity;
+
+		void push_back(const T& _value)
+		{
+			DEBUG_ASSERT(m_size < Capacity);
+			m_data[m_size++] = _value;
+		}
+
+		void pop_back()
+		{
+			DEBUG_ASSERT(m_size > 0);
+			m_size--;
+		}
+
+		void clear() { m_size = 0; }
+		u32 size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		T& operator[](u32 _index) { DEBUG_ASSERT(_index < m_size); return m_data[_index]; }
+		const T& operator[](u32 _index) const { DEBUG_ASSERT(_index < m_size); return m_data[_index]; }
+
+		T* data() { return m_data.data(); }
+		const T* data() const { return m_data.data(); }
+
+		T* begin() { return m_data.data(); }
+		T* end() { return m_data.data() + m_size; }
+		const T* begin() const { return m_data.data(); }
+		const T* end() const { return m_data.data() + m_size; }
+
+	private:
+		std::array<T, Capacity> m_data;
+		u32 m_size = 0;
+	};
+}
@@ -0,0 +1,108 @@
+#include "Core/LinearAllocator.h"
+
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace core
+{
+	void* LinearAllocator::allocateFromNextPage(size_t size)
+	{
+		// the current page is done, its tail stays unused until the next reset()
+		if (m_cursor)
+		{
+			m_usedInPreviousPages += size_t(m_cursor - m_pages[m_currentPage].data);
+			++m_currentPage;
+		}
+
+		// pages kept by reset() are reused in order, one too small for the request stays empty
+		while (m_currentPage < m_pages.size() && m_pages[m_currentPage].capacity < size)
+			++m_currentPage;
+
+		if (m_currentPage == m_pages.size())
+		{
+			// allocate at least m_pageSize, but if request is bigger allocate a larger page
+			Page p;
+			p.capacity = size > m_pageSize ? size : m_pageSize;
+			if (m_useHugePages)
+				p.capacity = (p.capacity + cHugePageSize - 1) & ~(cHugePageSize - 1);
+
+			p.data = allocatePage(p.capacity, m_useHugePages);
+			if (!p.data)
+			{
+				m_cursor = nullptr;
+				m_end = nullptr;
+				return nullptr; // allocation failed, return nullptr instead of throwing
+			}
+			m_pages.push_back(p);
+			m_reservedSize += p.capacity;
+		}
+
+		Page& page = m_pages[m_currentPage];
+		m_cursor = page.data + size;
+		m_end = page.data + page.capacity;
+		return page.data;
+	}
+
+	void LinearAllocator::release()
+	{
+		reset();
+		for (Page& p : m_pages)
+			freePage(p.data, m_useHugePages);
+		m_pages.clear();
+		m_reservedSize = 0;
+	}
+
+	ubyte* LinearAllocator::allocatePage(size_t capacity, bool useHugePages)
+	{
+#if defined(_WIN32)
+		if (useHugePages)
+		{
+			// large pages need the "Lock pages in memory" privilege, fall back to regular pages without it
+			const size_t largePageSize = GetLargePageMinimum();
+			if (largePageSize > 0 && capacity % largePageSize == 0)
+			{
+				if (void* data = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+					return static_cast<ubyte*>(data);
+			}
+			return static_cast<ubyte*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+		}
+#elif defined(__linux__)
+		if (useHugePages)
+		{
+			// a hint only, transparent huge pages may be disabled
+			void* data = std::aligned_alloc(cHugePageSize, capacity);
+			if (data)
+				madvise(data, capacity, MADV_HUGEPAGE);
+			return static_cast<ubyte*>(data);
+		}
+#else
+		(void)useHugePages;
+#endif
+		return static_cast<ubyte*>(operator new[](capacity, std::nothrow));
+	}
+
+	void LinearAllocator::freePage(ubyte* data, bool useHugePages)
+	{
+#if defined(_WIN32)
+		if (useHugePages)
+		{
+			VirtualFree(data, 0, MEM_RELEASE);
+			return;
+		}
+#elif defined(__linux__)
+		if (useHugePages)
+		{
+			std::free(data);
+			return;
+		}
+#else
+		(void)useHugePages;
+#endif
+		operator delete[](data);
+	}
+}
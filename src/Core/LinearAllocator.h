@@ -11,10 +11,16 @@
 
 namespace core
 {
+	// Bump-pointer arena: allocations take the next bytes of the current page and are released all at once by reset(),
+	// which keeps the pages for the next use. Nothing is destroyed, the objects must not need their destructor.
 	class LinearAllocator
 	{
 	public:
-		explicit LinearAllocator(size_t pageSize);
+		static constexpr size_t cHugePageSize = 2 * 1024 * 1024;
+
+		// With _useHugePages the pages are backed by huge pages when the system allows it (transparent huge pages on
+		// Linux, large pages on Windows), their size is then rounded up to cHugePageSize.
+		explicit LinearAllocator(size_t pageSize, bool useHugePages = false);
 		~LinearAllocator();
 
 		void* allocate(size_t size)
@@ -22,51 +28,16 @@ namespace core
 			if (size == 0)
 				return nullptr;
 
+			// pages start aligned and sizes are rounded, so the cursor always stays aligned
 			const size_t alignment = alignof(std::max_align_t);
-			// ensure user requested size considers alignment
-			size_t reqSize = (size + (alignment - 1)) & ~(alignment - 1);
-
-			// Try to find any existing page with enough free space (first-fit).
-			// This ensures that after reset() (which zeroes used on all pages)
-			// all pages are considered for reuse instead of only the last one.
-			for (auto &cur : m_pages)
+			const size_t reqSize = (size + (alignment - 1)) & ~(alignment - 1);
+			if (reqSize <= size_t(m_end - m_cursor))
 			{
-				std::uintptr_t base = reinterpret_cast<std::uintptr_t>(cur.data);
-				std::uintptr_t curr = base + cur.used;
-				std::uintptr_t aligned = (curr + (alignment - 1)) & ~(alignment - 1);
-				u32 padding = static_cast<u32>(aligned - curr);
-				if (cur.used + padding + reqSize <= cur.capacity)
-				{
-					void* ptr = cur.data + cur.used + padding;
-					cur.used += padding + static_cast<u32>(reqSize);
-					return ptr;
-				}
+				void* ptr = m_cursor;
+				m_cursor += reqSize;
+				return ptr;
 			}
-
-			// need a new page: allocate at least m_pageSize, but if request is bigger allocate a larger page
-			u32 newCapacity = m_pageSize;
-			if (reqSize > newCapacity)
-				newCapacity = static_cast<u32>(reqSize);
-
-			Page p;
-			p.data = static_cast<ubyte*>(operator new[](newCapacity, std::nothrow));
-			if (!p.data)
-				return nullptr; // allocation failed, return nullptr instead of throwing
-			p.capacity = newCapacity;
-			p.used = 0;
-
-			// compute aligned pointer on new page (base is naturally aligned from operator new[], but still align)
-			std::uintptr_t base = reinterpret_cast<std::uintptr_t>(p.data);
-			std::uintptr_t curr = base + p.used;
-			std::uintptr_t aligned = (curr + (alignment - 1)) & ~(alignment - 1);
-			u32 padding = static_cast<u32>(aligned - curr);
-
-			// allocate from new page
-			void* ptr = p.data + p.used + padding;
-			p.used += padding + static_cast<u32>(reqSize);
-
-			m_pages.push_back(p);
-			return ptr;
+			return allocateFromNextPage(reqSize);
 		}
 
 		template<typename T, typename ...Args>
@@ -77,43 +48,68 @@ namespace core
 			return static_cast<T*>(p);
 		}
 
+		// Bytes handed out since the last reset(), the unused tails of the filled pages excluded
+		size_t getUsedSize() const
+		{
+			return m_usedInPreviousPages + (m_cursor ? size_t(m_cursor - m_pages[m_currentPage].data) : 0);
+		}
+
+		// Bytes of the pages currently held
+		size_t getReservedSize() const { return m_reservedSize; }
+
+		// Largest used size reached since the construction or the last resetHighWaterMark()
+		size_t getHighWaterMark() const { return std::max(m_highWaterMark, getUsedSize()); }
+		void resetHighWaterMark() { m_highWaterMark = 0; }
+
 		void reset()
 		{
-			// reset used counters to reuse allocated pages (do not free memory)
-			for (auto &page : m_pages)
-				page.used = 0;
+			// rewind to the first page, the pages are kept and reused in order
+			m_highWaterMark = getHighWaterMark();
+			m_currentPage = 0;
+			m_usedInPreviousPages = 0;
+			m_cursor = nullptr;
+			m_end = nullptr;
 		}
 
+		// reset() and give the pages back to the system
+		void release();
+
 	private:
 		struct Page
 		{
 			ubyte* data = nullptr;
-			u32 capacity = 0;
-			u32 used = 0;
+			size_t capacity = 0;
 		};
 
-		u32 m_pageSize;
+		void* allocateFromNextPage(size_t size);
+		static ubyte* allocatePage(size_t capacity, bool useHugePages);
+		static void freePage(ubyte* data, bool useHugePages);
+
+		size_t m_pageSize;
+		bool m_useHugePages;
 		std::vector<Page> m_pages;
+		size_t m_currentPage = 0;
+		ubyte* m_cursor = nullptr; // nullptr until the first allocation after a reset
+		ubyte* m_end = nullptr;
+		size_t m_usedInPreviousPages = 0;
+		size_t m_reservedSize = 0;
+		size_t m_highWaterMark = 0;
 
 		// non-copyable
 		LinearAllocator(const LinearAllocator&) = delete;
 		LinearAllocator& operator=(const LinearAllocator&) = delete;
 	};
-	
+
 	// Inline ctor/dtor definitions
-	inline LinearAllocator::LinearAllocator(size_t pageSize)
-		: m_pageSize(static_cast<u32>(pageSize))
+	inline LinearAllocator::LinearAllocator(size_t pageSize, bool useHugePages)
+		: m_pageSize(pageSize)
+		, m_useHugePages(useHugePages)
 	{
 		assert(pageSize > 0);
 	}
 
 	inline LinearAllocator::~LinearAllocator()
 	{
-		for (auto &p : m_pages)
-		{
-			if (p.data)
-				operator delete[](p.data);
-		}
-		m_pages.clear();
+		release();
 	}
-}
\ No newline at end of file
+}
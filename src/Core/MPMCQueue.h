@@ -0,0 +1,107 @@
+#pragma once
+
+#include "type.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace core
+{
+	// Bounded lock-free queue for any number of producers and consumers (D. Vyukov's ring buffer). Each cell holds a
+	// sequence number telling whether it is ready to be written or read for the current lap of the ring: a push or a
+	// pop only claims a position with a compare-exchange and never waits for another thread.
+	template<typename T>
+	class MPMCQueue
+	{
+	public:
+		// _capacity is rounded up to a power of two
+		explicit MPMCQueue(size_t _capacity)
+		{
+			size_t capacity = 2;
+			while (capacity < _capacity)
+				capacity *= 2;
+
+			m_cells = std::make_unique<Cell[]>(capacity);
+			for (size_t i = 0; i < capacity; ++i)
+				m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+			m_mask = capacity - 1;
+		}
+
+		// false when the queue is full, _value is then left untouched
+		bool tryPush(T&& _value)
+		{
+			size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell& cell = m_cells[pos & m_mask];
+				const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+				const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+				if (diff == 0)
+				{
+					if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.m_value = std::move(_value);
+						cell.m_sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false; // the cell still holds the value of the previous lap
+				else
+					pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		// false when the queue is empty
+		bool tryPop(T& _value)
+		{
+			size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell& cell = m_cells[pos & m_mask];
+				const size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+				const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos + 1);
+				if (diff == 0)
+				{
+					if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						_value = std::move(cell.m_value);
+						cell.m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false; // not written yet
+				else
+					pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		// A hint only, a push in progress already counts
+		bool empty() const
+		{
+			return m_enqueuePos.load(std::memory_order_relaxed) == m_dequeuePos.load(std::memory_order_relaxed);
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> m_sequence;
+			T m_value;
+		};
+
+		std::unique_ptr<Cell[]> m_cells;
+		size_t m_mask = 0;
+
+		// producers and consumers update their own position, kept on separate cache lines
+		std::atomic<size_t> m_enqueuePos = 0;
+		[[maybe_unused]] ubyte m_padding[64 - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> m_dequeuePos = 0;
+
+		// non-copyable
+		MPMCQueue(const MPMCQueue&) = delete;
+		MPMCQueue& operator=(const MPMCQueue&) = delete;
+	};
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "type.h"
+
+#include <limits>
+
+namespace core
+{
+	// xoshiro256** generator, usable with the <random> distributions and std::shuffle.
+	// A stream is identified by a seed and a stream index so independent streams (one per thread, one per game)
+	// can be derived from a single seed.
+	class RandomStream
+	{
+	public:
+		using result_type = u64;
+
+		RandomStream(u64 _seed = 0, u64 _stream = 0) { seed(_seed, _stream); }
+
+		void seed(u64 _seed, u64 _stream = 0)
+		{
+			// splitmix64 expansion, never produces the all zero state
+			u64 x = _seed ^ (_stream * 0xD1B54A32D192ED03ull);
+			for (u64& s : m_state)
+			{
+				u64 z = (x += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				s = z ^ (z >> 31);
+			}
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()()
+		{
+			const u64 result = rotl(m_state[1] * 5, 7) * 9;
+			const u64 t = m_state[1] << 17;
+
+			m_state[2] ^= m_state[0];
+			m_state[3] ^= m_state[1];
+			m_state[1] ^= m_state[2];
+			m_state[0] ^= m_state[3];
+			m_state[2] ^= t;
+			m_state[3] = rotl(m_state[3], 45);
+
+			return result;
+		}
+
+	private:
+		static u64 rotl(u64 _x, int _k) { return (_x << _k) | (_x >> (64 - _k)); }
+
+		u64 m_state[4];
+	};
+}
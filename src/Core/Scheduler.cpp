@@ -0,0 +1,179 @@
+#include "Core/Scheduler.h"
+
+namespace core
+{
+	// the scheduler and worker index of the calling thread, nullptr outside the workers
+	static thread_local const Scheduler* t_pScheduler = nullptr;
+	static thread_local u32 t_workerIndex = 0;
+
+	Scheduler& Scheduler::get()
+	{
+		static Scheduler s_scheduler(std::max(1u, std::thread::hardware_concurrency()));
+		return s_scheduler;
+	}
+
+	Scheduler::Scheduler(u32 _numWorkers)
+	{
+		m_workers.resize(std::max(1u, _numWorkers));
+		for (std::unique_ptr<Worker>& pWorker : m_workers)
+			pWorker = std::make_unique<Worker>();
+
+		// started once all the deques exist, a worker may steal from any of them
+		for (u32 i = 0; i < m_workers.size(); ++i)
+			m_workers[i]->m_thread = std::thread(&Scheduler::workerLoop, this, i);
+	}
+
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_parkMutex);
+			m_stop = true;
+		}
+		m_parkCondition.notify_all();
+
+		for (std::unique_ptr<Worker>& pWorker : m_workers)
+			pWorker->m_thread.join();
+	}
+
+	void Scheduler::push(Task&& _task)
+	{
+		if (t_pScheduler == this)
+		{
+			Worker& worker = *m_workers[t_workerIndex];
+			std::lock_guard<std::mutex> lock(worker.m_mutex);
+			worker.m_tasks.push_back(std::move(_task));
+		}
+		else
+		{
+			// the shared queue is full: wait for the workers to take some, the caller never runs the task itself since
+			// it may only end when the caller tells it to stop (pondering)
+			while (!m_sharedTasks.tryPush(std::move(_task)))
+				std::this_thread::yield();
+		}
+
+		// pairs with the fence of a parking worker: either it sees the task or this sees it parked
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_numParked.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_parkMutex);
+			m_parkCondition.notify_one();
+		}
+	}
+
+	bool Scheduler::popTaskOf(const TaskGroup* _pGroup, Task& _task)
+	{
+		// the tasks of a group are in the deque of the worker running it, the most recent last
+		if (t_pScheduler != this)
+			return false;
+
+		Worker& worker = *m_workers[t_workerIndex];
+		std::lock_guard<std::mutex> lock(worker.m_mutex);
+		auto it = std::find_if(worker.m_tasks.rbegin(), worker.m_tasks.rend(), [_pGroup](const Task& task) { return task.m_pGroup == _pGroup; });
+		if (it == worker.m_tasks.rend())
+			return false;
+
+		_task = std::move(*it);
+		worker.m_tasks.erase(std::next(it).base());
+		return true;
+	}
+
+	bool Scheduler::findTask(u32 _workerIndex, Task& _task)
+	{
+		auto take = [&_task](Worker& worker, bool newest)
+		{
+			std::lock_guard<std::mutex> lock(worker.m_mutex);
+			if (worker.m_tasks.empty())
+				return false;
+
+			if (newest)
+			{
+				_task = std::move(worker.m_tasks.back());
+				worker.m_tasks.pop_back();
+			}
+			else
+			{
+				_task = std::move(worker.m_tasks.front());
+				worker.m_tasks.pop_front();
+			}
+			return true;
+		};
+
+		// own tasks first, then new work from outside, then the oldest task of another worker
+		if (take(*m_workers[_workerIndex], true) || m_sharedTasks.tryPop(_task))
+			return true;
+
+		const u32 numWorkers = getNumWorkers();
+		for (u32 i = 1; i < numWorkers; ++i)
+		{
+			if (take(*m_workers[(_workerIndex + i) % numWorkers], false))
+				return true;
+		}
+		return false;
+	}
+
+	bool Scheduler::hasQueuedTask()
+	{
+		if (!m_sharedTasks.empty())
+			return true;
+
+		for (std::unique_ptr<Worker>& pWorker : m_workers)
+		{
+			std::lock_guard<std::mutex> lock(pWorker->m_mutex);
+			if (!pWorker->m_tasks.empty())
+				return true;
+		}
+		return false;
+	}
+
+	void Scheduler::workerLoop(u32 _workerIndex)
+	{
+		t_pScheduler = this;
+		t_workerIndex = _workerIndex;
+
+		while (true)
+		{
+			Task task;
+			if (findTask(_workerIndex, task))
+			{
+				run(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_parkMutex);
+			if (m_stop)
+				return;
+
+			// a push after the check sees the worker parked and takes the lock to notify it
+			m_numParked.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!hasQueuedTask())
+				m_parkCondition.wait(lock);
+			m_numParked.fetch_sub(1);
+		}
+	}
+
+	void Scheduler::run(Task& _task)
+	{
+		_task.m_function();
+		_task.m_pGroup->onTaskDone();
+	}
+
+	void TaskGroup::wait()
+	{
+		Scheduler::Task task;
+		while (m_numPending.load() > 0 && m_scheduler.popTaskOf(this, task))
+			Scheduler::run(task);
+
+		// the tasks left are running on other workers
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this]() { return m_numPending.load() == 0; });
+	}
+
+	void TaskGroup::onTaskDone()
+	{
+		// under the lock: the waiter cannot see the group done and destroy it before the notification
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_numPending.fetch_sub(1) == 1)
+			m_condition.notify_all();
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "type.h"
+#include "MPMCQueue.h"
+#include "TaskFunction.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+	class TaskGroup;
+
+	// Process-wide work-stealing scheduler. Each worker owns a deque: it runs its own tasks last in first out and, when
+	// it has none, steals the oldest task of another worker. A task spawned from a task goes to the deque of the worker
+	// running it, so nested parallel work (a search inside a tournament game) runs on the same workers instead of adding
+	// threads. Threads outside the scheduler push to a shared lock-free queue, taken by the workers before they steal,
+	// and wait for room when it is full.
+	// An idle worker parks on a condition variable, a push only takes its lock when a worker is parked.
+	class Scheduler
+	{
+	public:
+		// The scheduler used by the whole process, one worker per hardware thread
+		static Scheduler& get();
+
+		explicit Scheduler(u32 _numWorkers);
+		~Scheduler();
+
+		u32 getNumWorkers() const { return u32(m_workers.size()); }
+
+	private:
+		friend class TaskGroup;
+
+		struct Task
+		{
+			TaskFunction m_function;
+			TaskGroup* m_pGroup = nullptr;
+		};
+
+		struct Worker
+		{
+			std::mutex m_mutex;
+			std::deque<Task> m_tasks;
+			std::thread m_thread;
+		};
+
+		void push(Task&& _task);
+		bool popTaskOf(const TaskGroup* _pGroup, Task& _task);
+		bool findTask(u32 _workerIndex, Task& _task);
+		bool hasQueuedTask();
+		void workerLoop(u32 _workerIndex);
+		static void run(Task& _task);
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+
+		static constexpr size_t cSharedQueueSize = 1024;
+		MPMCQueue<Task> m_sharedTasks{ cSharedQueueSize };
+
+		std::mutex m_parkMutex;
+		std::condition_variable m_parkCondition;
+		std::atomic<u32> m_numParked = 0;
+		bool m_stop = false;
+
+		// non-copyable
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+	};
+
+	// Tasks run by the scheduler and waited together. run() and wait() are called by the thread owning the group.
+	// run() never runs the task on the calling thread, so a task may last until its caller tells it to stop.
+	// On a worker, wait() first runs the tasks of the group nobody took yet, then blocks until the ones taken by other
+	// workers are done. The waiting thread never runs another task: a search waiting for its blocks does not start
+	// another game. A thread outside the scheduler only blocks.
+	class TaskGroup
+	{
+	public:
+		explicit TaskGroup(Scheduler& _scheduler = Scheduler::get()) : m_scheduler(_scheduler) {}
+		~TaskGroup() { wait(); }
+
+		template<typename F>
+		void run(F&& _function)
+		{
+			m_numPending.fetch_add(1);
+			m_scheduler.push({ TaskFunction(std::forward<F>(_function)), this });
+		}
+
+		void wait();
+
+	private:
+		friend class Scheduler;
+		void onTaskDone();
+
+		Scheduler& m_scheduler;
+		std::atomic<u32> m_numPending = 0;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+
+		// non-copyable
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+	};
+
+	// Splits [_first, _last) in at most _numBlocks blocks, calls _body(start, end) for each block on the scheduler and
+	// returns when all are done. A worker calling it runs the blocks nobody took.
+	template<typename F>
+	void parallelFor(u32 _first, u32 _last, const F& _body, u32 _numBlocks, Scheduler& _scheduler = Scheduler::get())
+	{
+		if (_first >= _last)
+			return;
+
+		const u32 size = _last - _first;
+		const u32 numBlocks = std::max(1u, std::min(_numBlocks, size));
+		const u32 blockSize = size / numBlocks;
+
+		TaskGroup group(_scheduler);
+		for (u32 b = 0; b < numBlocks; ++b)
+		{
+			const u32 start = _first + b * blockSize;
+			const u32 end = b == numBlocks - 1 ? _last : start + blockSize;
+			group.run([start, end, &_body]() { _body(start, end); });
+		}
+		group.wait();
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "type.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace core
+{
+	// Move-only void() callable for the scheduler tasks. A callable of up to cInlineSize bytes (a parallelFor block, a
+	// lambda capturing a few references) is stored inline, a larger one on the heap. Unlike std::function, spawning a
+	// small task never allocates.
+	class TaskFunction
+	{
+	public:
+		static constexpr size_t cInlineSize = 48;
+
+		TaskFunction() = default;
+
+		template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskFunction>>>
+		TaskFunction(F&& _function)
+		{
+			using Callable = std::decay_t<F>;
+			if constexpr (isInline<Callable>())
+				new(&m_storage) Callable(std::forward<F>(_function));
+			else
+				new(&m_storage) Callable*(new Callable(std::forward<F>(_function)));
+			m_pOps = &s_ops<Callable>;
+		}
+
+		TaskFunction(TaskFunction&& _other) noexcept { moveFrom(_other); }
+		TaskFunction& operator=(TaskFunction&& _other) noexcept
+		{
+			if (this != &_other)
+			{
+				reset();
+				moveFrom(_other);
+			}
+			return *this;
+		}
+		~TaskFunction() { reset(); }
+
+		void operator()() { m_pOps->invoke(&m_storage); }
+		explicit operator bool() const { return m_pOps != nullptr; }
+
+		void reset()
+		{
+			if (m_pOps)
+			{
+				m_pOps->destroy(&m_storage);
+				m_pOps = nullptr;
+			}
+		}
+
+	private:
+		using Storage = std::aligned_storage_t<cInlineSize>;
+
+		struct Ops
+		{
+			void (*invoke)(void* _pStorage);
+			void (*move)(void* _pDst, void* _pSrc); // move constructs into _pDst and destroys _pSrc
+			void (*destroy)(void* _pStorage);
+		};
+
+		template<typename Callable>
+		static constexpr bool isInline()
+		{
+			return sizeof(Callable) <= sizeof(Storage) && alignof(Callable) <= alignof(Storage) && std::is_nothrow_move_constructible_v<Callable>;
+		}
+
+		// inline: the callable itself is in the storage, otherwise a pointer to it
+		template<typename Callable>
+		static constexpr Ops makeOps()
+		{
+			if constexpr (isInline<Callable>())
+			{
+				return {
+					[](void* _pStorage) { (*static_cast<Callable*>(_pStorage))(); },
+					[](void* _pDst, void* _pSrc) { new(_pDst) Callable(std::move(*static_cast<Callable*>(_pSrc))); static_cast<Callable*>(_pSrc)->~Callable(); },
+					[](void* _pStorage) { static_cast<Callable*>(_pStorage)->~Callable(); }
+				};
+			}
+			else
+			{
+				return {
+					[](void* _pStorage) { (**static_cast<Callable**>(_pStorage))(); },
+					[](void* _pDst, void* _pSrc) { new(_pDst) Callable*(*static_cast<Callable**>(_pSrc)); },
+					[](void* _pStorage) { delete *static_cast<Callable**>(_pStorage); }
+				};
+			}
+		}
+
+		template<typename Callable>
+		static constexpr Ops s_ops = makeOps<Callable>();
+
+		void moveFrom(TaskFunction& _other)
+		{
+			if (_other.m_pOps)
+			{
+				_other.m_pOps->move(&m_storage, &_other.m_storage);
+				m_pOps = _other.m_pOps;
+				_other.m_pOps = nullptr;
+			}
+		}
+
+		Storage m_storage;
+		const Ops* m_pOps = nullptr;
+	};
+}